@@ -0,0 +1,77 @@
+// bench_memory_manager.c
+// Replays the same random allocation trace under every placement policy and
+// reports throughput and how fragmented the pool ends up.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "memory_manager.h"
+
+#define POOL_SIZE (8 << 20)
+#define LIVE_SLOTS 8192
+#define OPERATIONS 100000
+
+typedef struct workload {
+    const char *name;
+    // percentages of node sized, medium and large requests
+    int small, medium;
+} workload;
+
+static size_t request_size(const workload *w) {
+    int r = rand() % 100;
+    if (r < w->small) return 16;
+    if (r < w->small + w->medium) return 32 + rand() % 224;
+    return 1024 + rand() % 7168;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const workload *w, mem_policy policy, const char *policy_name) {
+    static void *slots[LIVE_SLOTS];
+    mem_options opts = {.policy = policy};
+    mem_init_opts(POOL_SIZE, &opts);
+    for (int i = 0; i < LIVE_SLOTS; i++) slots[i] = NULL;
+
+    srand(42);  // same trace for every policy
+    size_t failures = 0;
+    double start = now();
+    for (int i = 0; i < OPERATIONS; i++) {
+        int k = rand() % LIVE_SLOTS;
+        if (slots[k]) {
+            mem_free(slots[k]);
+            slots[k] = NULL;
+        } else {
+            slots[k] = mem_alloc(request_size(w));
+            if (!slots[k]) failures++;
+        }
+    }
+    double elapsed = now() - start;
+
+    mem_stats stats;
+    mem_get_stats(&stats);
+    double fragmentation =
+        stats.free_bytes ? 1.0 - (double)stats.largest_free / stats.free_bytes
+                         : 0.0;
+    printf("%-8s %-6s %10.0f ops/s %8zu failed %8zu free runs %6.1f%% fragmented\n",
+           w->name, policy_name, OPERATIONS / elapsed, failures,
+           stats.free_runs, fragmentation * 100);
+    mem_deinit();
+}
+
+int main() {
+    const workload workloads[] = {
+        {"nodes", 95, 5},
+        {"mixed", 70, 20},
+        {"large", 20, 30},
+    };
+    const char *names[] = {"first", "next", "best", "good"};
+    mem_policy policies[] = {MEM_FIRST_FIT, MEM_NEXT_FIT, MEM_BEST_FIT,
+                             MEM_GOOD_FIT};
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++)
+        for (int p = 0; p < 4; p++) run(&workloads[w], policies[p], names[p]);
+    return 0;
+}
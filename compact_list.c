@@ -0,0 +1,123 @@
+#include "compact_list.h"
+
+/// @brief Initializes the list
+/// @param head list head
+/// @param size size in bytes
+void clist_init(uint32_t* head, size_t size) {
+    mem_init(size + (4 * size) / sizeof(CNode));
+    *head = 0;
+}
+
+/// @brief returns the node behind an offset
+/// @param node node offset
+/// @return CNode* or NULL for 0
+CNode* clist_node(uint32_t node) { return mem_ptr(node); }
+
+/// @brief allocates a node
+/// @return its offset, 0 if out of memory
+static uint32_t clist_node_alloc(uint16_t data, uint32_t next) {
+    CNode* new_node = mem_alloc(sizeof(CNode));
+    if (!new_node) return 0;
+    new_node->data = data;
+    new_node->next = next;
+    return mem_offset(new_node);
+}
+
+/// @brief inserts last in the list
+/// @param head list head
+/// @param data data for the new node
+void clist_insert(uint32_t* head, uint16_t data) {
+    uint32_t* link = head;
+    while (*link) link = &clist_node(*link)->next;
+    *link = clist_node_alloc(data, 0);
+}
+
+/// @brief Inserts a node after prev_node
+/// @param prev_node node that will be before new node
+/// @param data data for the new node
+void clist_insert_after(uint32_t prev_node, uint16_t data) {
+    if (!prev_node) return;
+    CNode* prev = clist_node(prev_node);
+    uint32_t new_node = clist_node_alloc(data, prev->next);
+    if (new_node) prev->next = new_node;
+}
+
+/// @brief deletes the first node with data
+/// @param head list head
+/// @param data
+void clist_delete(uint32_t* head, uint16_t data) {
+    uint32_t* link = head;
+    while (*link && clist_node(*link)->data != data)
+        link = &clist_node(*link)->next;
+    if (!*link) return;
+    CNode* temp = clist_node(*link);
+    *link = temp->next;
+    mem_free(temp);
+}
+
+/// @brief return the node with data
+/// @param head list head
+/// @param data value to search for
+/// @return node offset or 0 if not found
+uint32_t clist_search(uint32_t* head, uint16_t data) {
+    uint32_t walker = *head;
+    while (walker && clist_node(walker)->data != data)
+        walker = clist_node(walker)->next;
+    return walker;
+}
+
+/// @brief displays all nodes
+/// @param head list head
+void clist_display(uint32_t* head) {
+    printf("[");
+    for (uint32_t walker = *head; walker;) {
+        CNode* node = clist_node(walker);
+        printf("%d", node->data);
+        walker = node->next;
+        if (walker) printf(", ");
+    }
+    printf("]");
+}
+
+/// @brief returns the number of nodes
+/// @param head list head
+/// @return int
+int clist_count_nodes(uint32_t* head) {
+    int counter = 0;
+    for (uint32_t walker = *head; walker; walker = clist_node(walker)->next)
+        counter++;
+    return counter;
+}
+
+/// @brief saves the list with the rest of the pool to path
+/// @param head list head
+/// @param path file to create or overwrite
+/// @return false on failure
+bool clist_snapshot(uint32_t* head, const char* path) {
+    mem_set_root(clist_node(*head));
+    return mem_snapshot(path);
+}
+
+/// @brief replaces the current list and pool with the ones saved by
+/// clist_snapshot, the links are offsets so nothing needs fixing up
+/// @param head list head
+/// @param path file written by clist_snapshot
+/// @return false if the file is unusable, the current list is kept then
+bool clist_restore(uint32_t* head, const char* path) {
+    if (!mem_restore(path)) return false;
+    *head = mem_offset(mem_get_root());
+    return true;
+}
+
+/// @brief frees all used memory
+/// @param head list head
+void clist_cleanup(uint32_t* head) {
+    uint32_t walker = *head;
+    while (walker) {
+        CNode* temp = clist_node(walker);
+        walker = temp->next;
+        mem_free(temp);
+    }
+    *head = 0;
+    mem_deinit();
+}
@@ -0,0 +1,39 @@
+#ifndef COMPACT_LIST_H
+#define COMPACT_LIST_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "common_defs.h"
+#include "memory_manager.h"
+
+// Nodes link to each other with mem_offset values instead of pointers, which
+// halves them to 8 bytes and keeps the list valid wherever the pool is mapped.
+// Lists and nodes are referred to by offset, 0 meaning none
+typedef struct CNode {
+    uint32_t next;
+    uint16_t data;
+} CNode;
+
+void clist_init(uint32_t* head, size_t size);
+
+CNode* clist_node(uint32_t node);
+
+void clist_insert(uint32_t* head, uint16_t data);
+
+void clist_insert_after(uint32_t prev_node, uint16_t data);
+
+void clist_delete(uint32_t* head, uint16_t data);
+
+uint32_t clist_search(uint32_t* head, uint16_t data);
+
+void clist_display(uint32_t* head);
+
+int clist_count_nodes(uint32_t* head);
+
+bool clist_snapshot(uint32_t* head, const char* path);
+
+bool clist_restore(uint32_t* head, const char* path);
+
+void clist_cleanup(uint32_t* head);
+
+#endif
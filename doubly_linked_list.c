@@ -0,0 +1,141 @@
+#include "doubly_linked_list.h"
+
+/// @brief Initializes the list
+/// @param head list head
+/// @param size size in bytes
+void dlist_init(DNode** head, size_t size) {
+    mem_init(size + (4 * size) / sizeof(DNode));
+    *head = NULL;
+}
+
+/// @brief inserts last in the list
+/// @param head list head
+/// @param data data for the new node
+void dlist_insert(DNode** head, uint16_t data) {
+    if (*head == NULL) {
+        DNode* new_node = mem_alloc(sizeof(DNode));
+        if (!new_node) return;
+        new_node->data = data;
+        new_node->next = NULL;
+        new_node->prev = new_node;
+        *head = new_node;
+        return;
+    }
+    dlist_insert_after(head, (*head)->prev, data);
+}
+
+/// @brief Inserts a node after prev_node
+/// @param head list head
+/// @param prev_node node that will be before new node
+/// @param data data for the new node
+void dlist_insert_after(DNode** head, DNode* prev_node, uint16_t data) {
+    if (prev_node == NULL) return;
+    DNode* new_node = mem_alloc(sizeof(DNode));
+    if (!new_node) return;
+    new_node->data = data;
+    new_node->next = prev_node->next;
+    new_node->prev = prev_node;
+    if (prev_node->next)
+        prev_node->next->prev = new_node;
+    else
+        (*head)->prev = new_node;  // new last node
+    prev_node->next = new_node;
+}
+
+/// @brief inserts before a node
+/// @param head list head
+/// @param next_node node that will be after new node
+/// @param data data for the new node
+void dlist_insert_before(DNode** head, DNode* next_node, uint16_t data) {
+    if (*head == NULL || next_node == NULL) return;
+    if (next_node != *head) {
+        dlist_insert_after(head, next_node->prev, data);
+        return;
+    }
+    DNode* new_node = mem_alloc(sizeof(DNode));
+    if (!new_node) return;
+    new_node->data = data;
+    new_node->next = next_node;
+    new_node->prev = next_node->prev;
+    next_node->prev = new_node;
+    *head = new_node;
+}
+
+/// @brief unlinks and frees node
+/// @param head list head
+/// @param node node in the list
+void dlist_delete_node(DNode** head, DNode* node) {
+    if (*head == NULL || node == NULL) return;
+    if (node == *head) {
+        *head = node->next;
+        if (*head) (*head)->prev = node->prev;
+    } else {
+        node->prev->next = node->next;
+        if (node->next)
+            node->next->prev = node->prev;
+        else
+            (*head)->prev = node->prev;  // removed the last node
+    }
+    mem_free(node);
+}
+
+/// @brief deletes the first node with data
+/// @param head list head
+/// @param data
+void dlist_delete(DNode** head, uint16_t data) {
+    dlist_delete_node(head, dlist_search(head, data));
+}
+
+/// @brief return the pointer to node with data or NULL if not found
+/// @param head list head
+/// @param data value to search for
+/// @return DNode* or NULL if node not found
+DNode* dlist_search(DNode** head, uint16_t data) {
+    DNode* walker = *head;
+    while (walker != NULL) {
+        if (walker->data == data) return walker;
+        walker = walker->next;
+    }
+    return NULL;
+}
+
+/// @brief returns the last node
+/// @param head list head
+/// @return DNode* or NULL if the list is empty
+DNode* dlist_tail(DNode** head) { return *head ? (*head)->prev : NULL; }
+
+/// @brief displays all nodes
+/// @param head list head
+void dlist_display(DNode** head) {
+    DNode* walker = *head;
+    printf("[");
+    while (walker != NULL) {
+        printf("%d", walker->data);
+        walker = walker->next;
+        if (walker) printf(", ");
+    }
+    printf("]");
+}
+
+/// @brief returns the number of nodes
+/// @param head list head
+/// @return int
+int dlist_count_nodes(DNode** head) {
+    int counter = 0;
+    for (DNode* walker = *head; walker != NULL; walker = walker->next)
+        counter++;
+    return counter;
+}
+
+/// @brief frees all used memory
+/// @param head list head
+void dlist_cleanup(DNode** head) {
+    DNode* walker = *head;
+    while (walker != NULL) {
+        DNode* temp = walker;
+        walker = walker->next;
+        mem_free(temp);
+    }
+    *head = NULL;
+    mem_deinit();
+}
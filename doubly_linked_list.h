@@ -0,0 +1,39 @@
+#ifndef DOUBLY_LINKED_LIST_H
+#define DOUBLY_LINKED_LIST_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "common_defs.h"
+#include "memory_manager.h"
+
+// The head's prev points at the last node so appending is O(1), every other
+// prev points at the node before it. The last node's next is NULL
+typedef struct DNode {
+    struct DNode* next;
+    struct DNode* prev;
+    uint16_t data;
+} DNode;
+
+void dlist_init(DNode** head, size_t size);
+
+void dlist_insert(DNode** head, uint16_t data);
+
+void dlist_insert_after(DNode** head, DNode* prev_node, uint16_t data);
+
+void dlist_insert_before(DNode** head, DNode* next_node, uint16_t data);
+
+void dlist_delete(DNode** head, uint16_t data);
+
+void dlist_delete_node(DNode** head, DNode* node);
+
+DNode* dlist_search(DNode** head, uint16_t data);
+
+DNode* dlist_tail(DNode** head);
+
+void dlist_display(DNode** head);
+
+int dlist_count_nodes(DNode** head);
+
+void dlist_cleanup(DNode** head);
+
+#endif
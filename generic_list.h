@@ -0,0 +1,105 @@
+#ifndef GENERIC_LIST_H
+#define GENERIC_LIST_H
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common_defs.h"
+#include "memory_manager.h"
+
+// Type specialised copies of the linked list, the element is stored inline
+// in the node so each one is a single allocation.
+//
+//   GENERIC_LIST(name, type, equals)
+//
+// declares name_node and name_init, name_insert, name_insert_after,
+// name_insert_before, name_delete, name_search, name_count_nodes and
+// name_cleanup, which work like their list_ counterparts but take and return
+// elements by pointer. equals(a, b) compares two elements given as pointers
+// and is expanded inline, GENERIC_LIST_EQ_VALUE for scalars and
+// GENERIC_LIST_EQ_BYTES for plain structs
+
+#define GENERIC_LIST_EQ_VALUE(a, b) (*(a) == *(b))
+#define GENERIC_LIST_EQ_BYTES(a, b) (memcmp((a), (b), sizeof(*(a))) == 0)
+
+#define GENERIC_LIST(name, type, equals)                                       \
+    typedef struct name##_node {                                               \
+        struct name##_node* next;                                              \
+        type data;                                                             \
+    } name##_node;                                                             \
+                                                                               \
+    /* size is the bytes of nodes the pool should hold */                      \
+    static inline void name##_init(name##_node** head, size_t size) {          \
+        mem_init(size + (4 * size) / sizeof(name##_node));                     \
+        *head = NULL;                                                          \
+    }                                                                          \
+                                                                               \
+    static inline name##_node* name##_node_new(const type* data,               \
+                                               name##_node* next) {            \
+        name##_node* new_node = mem_alloc(sizeof(name##_node));                \
+        if (!new_node) return NULL;                                            \
+        new_node->data = *data;                                                \
+        new_node->next = next;                                                 \
+        return new_node;                                                       \
+    }                                                                          \
+                                                                               \
+    static inline void name##_insert(name##_node** head, const type* data) {   \
+        name##_node** link = head;                                             \
+        while (*link) link = &(*link)->next;                                   \
+        *link = name##_node_new(data, NULL);                                   \
+    }                                                                          \
+                                                                               \
+    static inline void name##_insert_after(name##_node* prev_node,             \
+                                           const type* data) {                 \
+        if (prev_node == NULL) return;                                         \
+        name##_node* new_node = name##_node_new(data, prev_node->next);        \
+        if (new_node) prev_node->next = new_node;                              \
+    }                                                                          \
+                                                                               \
+    static inline void name##_insert_before(                                   \
+        name##_node** head, name##_node* next_node, const type* data) {        \
+        name##_node** link = head;                                             \
+        while (*link && *link != next_node) link = &(*link)->next;             \
+        if (*link == NULL) return;                                             \
+        name##_node* new_node = name##_node_new(data, next_node);              \
+        if (new_node) *link = new_node;                                        \
+    }                                                                          \
+                                                                               \
+    static inline name##_node* name##_search(name##_node** head,               \
+                                             const type* data) {               \
+        for (name##_node* walker = *head; walker; walker = walker->next)       \
+            if (equals(&walker->data, data)) return walker;                    \
+        return NULL;                                                           \
+    }                                                                          \
+                                                                               \
+    static inline void name##_delete(name##_node** head, const type* data) {   \
+        name##_node** link = head;                                             \
+        while (*link && !equals(&(*link)->data, data)) link = &(*link)->next;  \
+        if (*link == NULL) return;                                             \
+        name##_node* temp = *link;                                             \
+        *link = temp->next;                                                    \
+        mem_free(temp);                                                        \
+    }                                                                          \
+                                                                               \
+    static inline int name##_count_nodes(name##_node** head) {                 \
+        int counter = 0;                                                       \
+        for (name##_node* walker = *head; walker; walker = walker->next)       \
+            counter++;                                                         \
+        return counter;                                                        \
+    }                                                                          \
+                                                                               \
+    static inline void name##_cleanup(name##_node** head) {                    \
+        name##_node* walker = *head;                                           \
+        while (walker) {                                                       \
+            name##_node* temp = walker;                                        \
+            walker = walker->next;                                             \
+            mem_free(temp);                                                    \
+        }                                                                      \
+        *head = NULL;                                                          \
+        mem_deinit();                                                          \
+    }
+
+// the default instantiation, laid out like linked_list.h's Node
+GENERIC_LIST(u16_list, uint16_t, GENERIC_LIST_EQ_VALUE)
+
+#endif
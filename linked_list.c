@@ -1,9 +1,114 @@
 #include "linked_list.h"
 
+#include "perf_counters.h"
+
+// nodes come from the memory manager arena instead of mem_alloc
+static bool list_arena = false;
+// nodes are reference counted and may be shared between lists, see
+// list_init_persistent
+static bool list_persistent = false;
+
+// from this many nodes list_sort uses the linear radix sort
+#define LIST_RADIX_MIN 256
+// list_insert_many allocates this many nodes at a time
+#define LIST_BATCH_SIZE 64
+// list_search_many answers this many keys per traversal
+#define LIST_SEARCH_CHUNK 1024
+
+/// @brief starts loading the node after node, so it is likely cached by the
+/// time a traversal gets there
+/// @param node may be NULL
+static inline void list_prefetch(Node* node) {
+    if (node) __builtin_prefetch(node->next);
+}
+
+/// @brief allocates a node from wherever the list keeps its nodes
+/// @return Node* or NULL if out of memory
+static Node* list_node_alloc() {
+    if (list_arena) return mem_arena_alloc(sizeof(Node));
+    if (list_persistent) return mem_alloc_rc(sizeof(Node));
+    return mem_alloc(sizeof(Node));
+}
+
+/// @brief frees a node, arena nodes are only reclaimed by list_discard and
+/// shared persistent nodes once the last list lets go of them
+/// @param node
+static void list_node_free(Node* node) {
+    if (list_persistent)
+        mem_release(node);
+    else if (!list_arena)
+        mem_free(node);
+}
+
+/// @brief drops a reference to a persistent node, and to the rest of the list
+/// through it if that was the last one
+/// @param node may be NULL
+static void list_node_drop(Node* node) {
+    while (node) {
+        Node* next = node->next;
+        if (!mem_release(node)) return;
+        node = next;
+    }
+}
+
+/// @brief makes the node *link points at one no other list shares, copying
+/// it if it is. The copy shares the rest of the list. Nodes are only ever
+/// exclusive when every node before them is, so a walk that calls this on
+/// each node it passes copies just the shared part of the path
+/// @param link head or the next field of an exclusive node
+/// @return the node, NULL if out of memory
+static Node* list_own(Node** link) {
+    Node* node = *link;
+    if (!list_persistent || mem_refcount(node) == 1) return node;
+    Node* copy = mem_alloc_rc(sizeof(Node));
+    if (!copy) return NULL;
+    copy->data = node->data;
+    copy->next = node->next;
+    if (copy->next) mem_retain(copy->next);
+    *link = copy;
+    list_node_drop(node);
+    return copy;
+}
+
+/// @brief copies every shared node so the whole list can be changed in place
+/// @param head list head
+/// @return false if out of memory, the list is still valid then
+static bool list_unshare(Node** head) {
+    for (Node** link = head; *link; link = &(*link)->next)
+        if (!list_own(link)) return false;
+    return true;
+}
+
 /// @brief Initializes the list
 /// @param head list head
 void list_init(Node** head, size_t size) {
     mem_init(size + (4 * size)/sizeof(Node) );
+    list_arena = false;
+    list_persistent = false;
+    *head = NULL;
+}
+
+/// @brief Initializes the list with reference counted nodes, so that
+/// list_clone is O(1) and the clones share their nodes. Changing a list
+/// copies only the shared nodes on the way to the change. list_insert_after
+/// does nothing on these lists as it can't tell which nodes are shared
+/// @param head list head
+/// @param size size in bytes
+void list_init_persistent(Node** head, size_t size) {
+    mem_init(size + (8 * size) / sizeof(Node));  // headers and counts
+    list_arena = false;
+    list_persistent = true;
+    *head = NULL;
+}
+
+/// @brief Initializes the list with its nodes bump allocated from an arena,
+/// deleted nodes are not reused until list_discard
+/// @param head list head
+/// @param size size in bytes
+void list_init_arena(Node** head, size_t size) {
+    mem_init(size + 8);  // room for the arena's block header and alignment
+    list_arena = mem_arena_init(size);
+    list_persistent = false;
     *head = NULL;
 }
 
@@ -11,27 +116,56 @@ void list_init(Node** head, size_t size) {
 /// @param head list head
 /// @param data data for the new node
 void list_insert(Node** head, uint16_t data) {
-    Node* new_node = mem_alloc(sizeof(Node));
-    if (!new_node) return;
-    new_node->data = data;
-    new_node->next = NULL;
-    if (*head == NULL) {
-        *head = new_node;
-        return;
+    PERF_BEGIN("list_insert");
+    Node* new_node = list_node_alloc();
+    if (new_node) {
+        new_node->data = data;
+        new_node->next = NULL;
+        Node** tail = head;
+        while (*tail && list_own(tail)) tail = &(*tail)->next;
+        if (*tail)
+            list_node_free(new_node);
+        else
+            *tail = new_node;
     }
-    Node* walker = *head;
-    while (walker->next) {
-        walker = walker->next;
+    PERF_END();
+}
+
+/// @brief inserts count nodes last in linked list, in order, allocating them
+/// in batches so they end up next to each other in the pool
+/// @param head list head
+/// @param data data for the new nodes
+/// @param count number of nodes, stops early if out of memory
+void list_insert_many(Node** head, const uint16_t* data, size_t count) {
+    if (list_persistent && !list_unshare(head)) return;
+    Node** tail = head;
+    while (*tail) tail = &(*tail)->next;
+    Node* nodes[LIST_BATCH_SIZE];
+    for (size_t done = 0; done < count;) {
+        size_t batch = count - done;
+        if (batch > LIST_BATCH_SIZE) batch = LIST_BATCH_SIZE;
+        if (list_arena || list_persistent) {
+            for (size_t i = 0; i < batch; i++)
+                if (!(nodes[i] = list_node_alloc())) batch = i;
+        } else if (!mem_alloc_batch(sizeof(Node), batch, (void**)nodes)) {
+            batch = 0;
+        }
+        if (batch == 0) return;
+        for (size_t i = 0; i < batch; i++) {
+            nodes[i]->data = data[done++];
+            nodes[i]->next = NULL;
+            *tail = nodes[i];
+            tail = &nodes[i]->next;
+        }
     }
-    walker->next = new_node;
 }
 
 /// @brief Inserts a node after prev_node
 /// @param prev_nodenode that will be before new node
 /// @param data data for the new node
 void list_insert_after(Node* prev_node, uint16_t data) {
-    if (prev_node == NULL) return;
-    Node* new_node = mem_alloc(sizeof(Node));
+    if (prev_node == NULL || list_persistent) return;
+    Node* new_node = list_node_alloc();
     if (!new_node) return;
     new_node->next = prev_node->next;
     new_node->data = data;
@@ -44,47 +178,41 @@ void list_insert_after(Node* prev_node, uint16_t data) {
 /// @param data data for the new node
 void list_insert_before(Node** head, Node* next_node, uint16_t data) {
     if (*head == NULL) return;  // ERROR
-    Node* walker = *head;
-    if (next_node == *head) {
-        Node* new_node = mem_alloc(sizeof(Node));
-        if (!new_node) return;
-
-        new_node->data = data;
-        new_node->next = *head;
-        *head = new_node;
-        return;
+    Node** link = head;
+    while (*link != next_node && *link != NULL && list_own(link)) {
+        link = &(*link)->next;
     }
-
-    while (walker->next != next_node && walker->next != NULL) {
-        walker = walker->next;
-    }
-    if (walker->next == NULL) return;  // ERRROR
-    Node* new_node = mem_alloc(sizeof(Node));
+    if (*link != next_node || next_node == NULL) return;  // ERRROR
+    Node* new_node = list_node_alloc();
     if (!new_node) return;
-    walker->next = new_node;
-    walker->next->next = next_node;
-    walker->next->data = data;
+    // the new node takes over the reference to next_node
+    new_node->next = next_node;
+    new_node->data = data;
+    *link = new_node;
 }
 
 /// @brief deletes the Node with data
 /// @param head list head
 /// @param data
 void list_delete(Node** head, uint16_t data) {
-    if (*head == NULL) return;
-    if ((*head)->data == data) {
-        Node* temp = *head;
-        *head = (*head)->next;
-        mem_free(temp);
-        return;
+    PERF_BEGIN("list_delete");
+    Node** link = head;
+    // a persistent list would copy the whole path only to find nothing
+    bool found = !list_persistent || list_search(head, data);
+    while (found && *link && (*link)->data != data && list_own(link))
+        link = &(*link)->next;
+    if (found && *link && (*link)->data == data) {
+        Node* temp = *link;
+        *link = temp->next;
+        if (list_persistent) {
+            // temp may live on in other lists, along with its reference
+            if (temp->next) mem_retain(temp->next);
+            list_node_drop(temp);
+        } else {
+            list_node_free(temp);
+        }
     }
-    Node* walker = *head;
-    while (walker->next != NULL && walker->next->data != data) {
-        walker = walker->next;
-    }
-    if (walker->next == NULL) return;
-    Node* temp = walker->next;
-    walker->next = temp->next;
-    mem_free(temp);
+    PERF_END();
 }
 
 /// @brief return the pointer to node with data or NULL if not found
@@ -92,12 +220,67 @@ void list_delete(Node** head, uint16_t data) {
 /// @param data value to search for
 /// @return Node* or NULL if node not found
 Node* list_search(Node** head, uint16_t data) {
+    PERF_BEGIN("list_search");
     Node* walker = *head;
-    while (walker != NULL) {
-        if (walker->data == data) return walker;
+    while (walker != NULL && walker->data != data) {
+        list_prefetch(walker->next);
         walker = walker->next;
     }
-    return NULL;
+    PERF_END();
+    return walker;
+}
+
+static int list_key_cmp(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/// @brief looks up many values at once, walking the list a single time for
+/// every LIST_SEARCH_CHUNK keys rather than once per key. A bitmap of the
+/// values still missing keeps the check per node to one bit test
+/// @param head list head
+/// @param keys values to search for, duplicates are fine
+/// @param n number of keys
+/// @param results results[i] is set to the first node holding keys[i], NULL
+/// if there is none
+void list_search_many(Node** head, const uint16_t* keys, size_t n,
+                      Node** results) {
+    PERF_BEGIN("list_search_many");
+    uint64_t pending[(UINT16_MAX + 1) / 64];
+    // key << 16 | index into the chunk, sorted so a key's slots are adjacent
+    uint32_t order[LIST_SEARCH_CHUNK];
+    for (size_t base = 0; base < n; base += LIST_SEARCH_CHUNK) {
+        size_t count = n - base;
+        if (count > LIST_SEARCH_CHUNK) count = LIST_SEARCH_CHUNK;
+        memset(pending, 0, sizeof(pending));
+        for (size_t i = 0; i < count; i++) {
+            uint16_t key = keys[base + i];
+            results[base + i] = NULL;
+            order[i] = (uint32_t)key << 16 | i;
+            pending[key / 64] |= 1ull << (key % 64);
+        }
+        qsort(order, count, sizeof(uint32_t), list_key_cmp);
+        size_t left = count;
+        for (Node* walker = *head; walker && left; walker = walker->next) {
+            list_prefetch(walker->next);
+            uint16_t data = walker->data;
+            uint64_t bit = 1ull << (data % 64);
+            if (!(pending[data / 64] & bit)) continue;
+            pending[data / 64] &= ~bit;
+            size_t low = 0, high = count;
+            while (low < high) {
+                size_t mid = (low + high) / 2;
+                if (order[mid] >> 16 < data)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            for (; low < count && order[low] >> 16 == data; low++, left--)
+                results[base + (order[low] & 0xFFFF)] = walker;
+        }
+    }
+    PERF_END();
 }
 
 /// @brief displays all nodes
@@ -128,21 +311,388 @@ int list_count_nodes(Node** head) {
     Node* walker = *head;
     int counter = 0;
     while (walker != NULL) {
+        list_prefetch(walker->next);
         counter++;
         walker = walker->next;
     }
     return counter;
 }
 
-/// @brief frees all used memory
+/// @brief returns a cursor on the first node of the list
 /// @param head list head
-void list_cleanup(Node** head) {
+list_cursor list_cursor_init(Node** head) {
+    list_cursor cursor = {.node = *head};
+    return cursor;
+}
+
+/// @brief reads the value under the cursor and moves it one node on
+/// @param cursor from list_cursor_init
+/// @param data set to the value
+/// @return false once the end of the list is reached, data is then untouched
+bool list_cursor_next(list_cursor* cursor, uint16_t* data) {
+    Node* node = cursor->node;
+    if (!node) return false;
+    list_prefetch(node->next);
+    *data = node->data;
+    cursor->node = node->next;
+    return true;
+}
+
+/// @brief calls callback on every node in order, the callback may free the
+/// node it is given
+/// @param head list head
+/// @param callback called with each node and ctx
+/// @param ctx passed through to callback
+void list_for_each(Node** head, void (*callback)(Node* node, void* ctx),
+                   void* ctx) {
     Node* walker = *head;
     while (walker != NULL) {
-        Node* temp = walker;
+        Node* next = walker->next;
+        list_prefetch(next);
+        callback(walker, ctx);
+        walker = next;
+    }
+}
+
+/// @brief copies the values of the first n nodes into out
+/// @param head list head
+/// @param out room for n values
+/// @param n maximum number of values
+/// @return number of values copied
+size_t list_copy_to_array(Node** head, uint16_t* out, size_t n) {
+    size_t copied = 0;
+    Node* walker = *head;
+    while (walker != NULL && copied < n) {
+        list_prefetch(walker->next);
+        out[copied++] = walker->data;
         walker = walker->next;
-        mem_free(temp);
     }
+    return copied;
+}
+
+/// @brief merges two sorted chains, equal values keep a before b
+/// @param tail set to the last node of the result
+/// @return first node of the merged chain
+static Node* list_merge(Node* a, Node* b, Node** tail) {
+    Node start;
+    Node* last = &start;
+    while (a && b) {
+        if (b->data < a->data) {
+            last->next = b;
+            b = b->next;
+        } else {
+            last->next = a;
+            a = a->next;
+        }
+        last = last->next;
+    }
+    last->next = a ? a : b;
+    while (last->next) last = last->next;
+    *tail = last;
+    return start.next;
+}
+
+/// @brief cuts the chain after count nodes
+/// @return the rest of the chain, NULL if it was shorter
+static Node* list_split(Node* node, int count) {
+    for (int i = 1; node && i < count; i++) node = node->next;
+    if (!node) return NULL;
+    Node* rest = node->next;
+    node->next = NULL;
+    return rest;
+}
+
+/// @brief bottom-up merge sort, merges runs of 1, 2, 4... nodes in place
+/// @param head list head
+/// @param count number of nodes
+static void list_merge_sort(Node** head, int count) {
+    Node start = {.next = *head};
+    for (int width = 1; width < count; width *= 2) {
+        Node* tail = &start;
+        Node* rest = start.next;
+        while (rest) {
+            Node* left = rest;
+            Node* right = list_split(left, width);
+            rest = list_split(right, width);
+            tail->next = list_merge(left, right, &tail);
+        }
+    }
+    *head = start.next;
+}
+
+/// @brief LSD radix sort on the 16 bit data, one pass per byte, relinking the
+/// nodes into 256 buckets and back
+/// @param head list head
+static void list_radix_sort(Node** head) {
+    Node* buckets[256];
+    Node** tails[256];
+    for (int shift = 0; shift < 16; shift += 8) {
+        for (int i = 0; i < 256; i++) {
+            buckets[i] = NULL;
+            tails[i] = &buckets[i];
+        }
+        for (Node* walker = *head; walker; walker = walker->next) {
+            int digit = (walker->data >> shift) & 0xFF;
+            *tails[digit] = walker;
+            tails[digit] = &walker->next;
+        }
+        Node** link = head;
+        for (int i = 0; i < 256; i++) {
+            if (!buckets[i]) continue;
+            *link = buckets[i];
+            link = tails[i];
+        }
+        *link = NULL;
+    }
+}
+
+/// @brief sorts the list in ascending order by relinking the nodes, stable
+/// @param head list head
+void list_sort(Node** head) {
+    if (list_persistent && !list_unshare(head)) return;
+    int count = list_count_nodes(head);
+    if (count < 2) return;
+    if (count >= LIST_RADIX_MIN)
+        list_radix_sort(head);
+    else
+        list_merge_sort(head, count);
+}
+
+/// @brief reverses the order of the nodes
+/// @param head list head
+void list_reverse(Node** head) {
+    if (list_persistent && !list_unshare(head)) return;
+    Node* reversed = NULL;
+    Node* walker = *head;
+    while (walker) {
+        Node* next = walker->next;
+        walker->next = reversed;
+        reversed = walker;
+        walker = next;
+    }
+    *head = reversed;
+}
+
+/// @brief moves every node of the sorted list other into the sorted list head,
+/// keeping it sorted
+/// @param head list head
+/// @param other list head, empty afterwards
+void list_merge_sorted(Node** head, Node** other) {
+    if (list_persistent && !(list_unshare(head) && list_unshare(other))) return;
+    Node* tail;
+    *head = list_merge(*head, *other, &tail);
+    *other = NULL;
+}
+
+/// @brief removes repeated values that follow each other, on a sorted list
+/// that leaves every value once
+/// @param head list head
+void list_unique(Node** head) {
+    if (list_persistent && !list_unshare(head)) return;
+    Node* walker = *head;
+    while (walker && walker->next) {
+        if (walker->next->data == walker->data) {
+            Node* temp = walker->next;
+            walker->next = temp->next;
+            list_node_free(temp);
+        } else {
+            walker = walker->next;
+        }
+    }
+}
+
+/// @brief saves the list with the rest of the pool to path, arena backed
+/// lists can't be saved
+/// @param head list head
+/// @param path file to create or overwrite
+/// @return false on failure
+bool list_snapshot(Node** head, const char* path) {
+    if (list_arena) return false;
+    mem_set_root(*head);
+    return mem_snapshot(path);
+}
+
+/// @brief replaces the current list and pool with the ones saved by
+/// list_snapshot
+/// @param head list head
+/// @param path file written by list_snapshot
+/// @return false if the file is unusable, the current list is kept then
+bool list_restore(Node** head, const char* path) {
+    if (!mem_restore(path)) return false;
+    list_arena = false;
+    *head = mem_get_root();
+    // links move together, so if one didn't none did
+    if (!*head || mem_relocate((*head)->next) == (*head)->next) return true;
+    for (Node* walker = *head; walker; walker = walker->next)
+        walker->next = mem_relocate(walker->next);
+    return true;
+}
+
+/// @brief the link that points at node, copying the shared nodes on the way
+/// in a persistent list
+/// @param head list head
+/// @param node node to find, NULL for the end of the list
+/// @return NULL if node isn't in the list or out of memory
+static Node** list_link_to(Node** head, Node* node) {
+    Node** link = head;
+    while (*link != node) {
+        if (!*link || !list_own(link)) return NULL;
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+/// @brief moves every node of other to the end of the list, other is left
+/// empty. Nothing is allocated or copied
+/// @param head list head
+/// @param other list to move
+void list_concat(Node** head, Node** other) {
+    if (*other == NULL) return;
+    Node** tail = list_link_to(head, NULL);
+    if (!tail) return;
+    // a persistent list hands its reference to the first node over as well
+    *tail = *other;
+    *other = NULL;
+}
+
+/// @brief moves every node of other into the list right after prev_node,
+/// other is left empty. Costs a walk to the end of other, nothing is
+/// allocated
+/// @param head list head
+/// @param prev_node node to splice after, NULL for the front
+/// @param other list to move
+void list_splice(Node** head, Node* prev_node, Node** other) {
+    if (*other == NULL) return;
+    Node** link = head;
+    if (prev_node && list_persistent) {
+        link = list_link_to(head, prev_node);
+        if (!link || !list_own(link)) return;
+        link = &(*link)->next;
+    } else if (prev_node) {
+        link = &prev_node->next;
+    }
+    // other's last node is about to change
+    if (list_persistent && !list_unshare(other)) return;
+    Node* tail = *other;
+    while (tail->next) tail = tail->next;
+    tail->next = *link;
+    *link = *other;
+    *other = NULL;
+}
+
+/// @brief cuts the list after node in O(1), everything after it becomes a
+/// list of its own. Not for persistent lists, where it does nothing
+/// @param node last node to keep
+/// @return head of the rest, NULL if there is none
+Node* list_split_at(Node* node) {
+    if (node == NULL || list_persistent) return NULL;
+    Node* rest = node->next;
+    node->next = NULL;
+    return rest;
+}
+
+/// @brief deletes start, end and every node between them, handing the nodes
+/// back LIST_BATCH_SIZE at a time with mem_free_batch
+/// @param head list head
+/// @param start first node to delete
+/// @param end last node to delete, NULL for the end of the list
+void list_delete_range(Node** head, Node* start, Node* end) {
+    if (start == NULL) return;
+    Node* last = start;
+    while (last != end && last->next) last = last->next;
+    if (end && last != end) return;  // end isn't after start
+    Node** link = list_link_to(head, start);
+    if (!link) return;
+    *link = last->next;
+    if (list_persistent) {
+        // the range may live on in other lists, and its last node's
+        // reference to the rest with it
+        if (last->next) mem_retain(last->next);
+        list_node_drop(start);
+        return;
+    }
+    if (list_arena) return;
+    Node* batch[LIST_BATCH_SIZE];
+    size_t count = 0;
+    Node* walker = start;
+    while (walker) {
+        Node* next = (walker == last) ? NULL : walker->next;
+        batch[count++] = walker;
+        if (count == LIST_BATCH_SIZE || !next) {
+            mem_free_batch((void**)batch, count);
+            count = 0;
+        }
+        walker = next;
+    }
+}
+
+/// @brief a second list with the same contents in O(1), sharing every node
+/// with head. Only for lists from list_init_persistent
+/// @param head list head
+/// @return head of the clone, release it with list_release
+Node* list_clone(Node** head) {
+    if (!list_persistent) return NULL;
+    if (*head) mem_retain(*head);
+    return *head;
+}
+
+/// @brief lets go of a list, freeing the nodes no clone still shares
+/// @param head list head
+void list_release(Node** head) {
+    if (list_persistent) {
+        list_node_drop(*head);
+    } else if (!list_arena) {
+        Node* walker = *head;
+        while (walker != NULL) {
+            Node* temp = walker;
+            walker = walker->next;
+            list_node_free(temp);
+        }
+    }
+    *head = NULL;
+}
+
+/// @brief drops every node of an arena backed list at once, the arena is kept
+/// for the next list
+/// @param head list head
+void list_discard(Node** head) {
+    mem_arena_reset();
     *head = NULL;
+}
+
+/// @brief empties the list, handing its nodes to the memory manager's
+/// reclaimer thread instead of freeing them here. The pool is kept, use
+/// mem_flush_deferred to wait for the nodes or list_cleanup to end it all
+/// @param head list head
+void list_cleanup_async(Node** head) {
+    if (list_arena) {
+        list_discard(head);
+        return;
+    }
+    if (list_persistent) {
+        list_release(head);
+        return;
+    }
+    Node* walker = *head;
+    *head = NULL;
+    while (walker != NULL) {
+        Node* next = walker->next;
+        mem_free_deferred(walker);
+        walker = next;
+    }
+}
+
+/// @brief frees all used memory
+/// @param head list head
+void list_cleanup(Node** head) {
+    if (list_arena) {
+        list_discard(head);
+        mem_arena_release();
+        list_arena = false;
+        mem_deinit();
+        return;
+    }
+    list_release(head);
+    list_persistent = false;
     mem_deinit();
 }
\ No newline at end of file
@@ -11,10 +11,21 @@ typedef struct Node {
     uint16_t data;
 } Node;
 
+// walks a list front to back, see list_cursor_next
+typedef struct list_cursor {
+    Node* node;
+} list_cursor;
+
 void list_init(Node** head, size_t size);
 
+void list_init_arena(Node** head, size_t size);
+
+void list_init_persistent(Node** head, size_t size);
+
 void list_insert(Node** head, uint16_t data);
 
+void list_insert_many(Node** head, const uint16_t* data, size_t count);
+
 void list_insert_after(Node* prev_node, uint16_t data);
 
 void list_insert_before(Node** head, Node* next_node, uint16_t data);
@@ -23,12 +34,52 @@ void list_delete(Node** head, uint16_t data);
 
 Node* list_search(Node** head, uint16_t data);
 
+void list_search_many(Node** head, const uint16_t* keys, size_t n,
+                      Node** results);
+
 void list_display(Node** head);
 
 void list_display_range(Node** head, Node* start_node, Node* end_node);
 
 int list_count_nodes(Node** head);
 
+list_cursor list_cursor_init(Node** head);
+
+bool list_cursor_next(list_cursor* cursor, uint16_t* data);
+
+void list_for_each(Node** head, void (*callback)(Node* node, void* ctx),
+                   void* ctx);
+
+size_t list_copy_to_array(Node** head, uint16_t* out, size_t n);
+
+void list_sort(Node** head);
+
+void list_reverse(Node** head);
+
+void list_merge_sorted(Node** head, Node** other);
+
+void list_unique(Node** head);
+
+void list_concat(Node** head, Node** other);
+
+void list_splice(Node** head, Node* prev_node, Node** other);
+
+Node* list_split_at(Node* node);
+
+void list_delete_range(Node** head, Node* start, Node* end);
+
+bool list_snapshot(Node** head, const char* path);
+
+bool list_restore(Node** head, const char* path);
+
+Node* list_clone(Node** head);
+
+void list_release(Node** head);
+
+void list_discard(Node** head);
+
 void list_cleanup(Node** head);
 
+void list_cleanup_async(Node** head);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,171 @@
+// malloc_shim.c
+// Drop-in replacement for the libc allocator on top of the memory manager,
+// load it with LD_PRELOAD=./libmalloc_shim.so. Everything but the functions
+// below is built with hidden visibility so a program that also links
+// libmemory_manager.so keeps its own, separate pool.
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "memory_manager.h"
+
+#define SHIM_EXPORT __attribute__((visibility("default")))
+
+// pages are only touched once used, so both of these are cheap up front.
+// The reservation stays below the 16 GiB the free block index can reach
+#define SHIM_INITIAL_SIZE ((size_t)64 << 20)
+#define SHIM_RESERVE_SIZE ((size_t)15 << 30)
+#define SHIM_GROW_SIZE ((size_t)64 << 20)
+// what malloc promises, alignof(max_align_t)
+#define SHIM_ALIGNMENT 16
+
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool shim_ready = false;
+
+// a thread that forks while another one holds shim_lock would leave the
+// child with a lock nobody is going to release
+static void shim_prepare() { pthread_mutex_lock(&shim_lock); }
+
+static void shim_parent() { pthread_mutex_unlock(&shim_lock); }
+
+static void shim_child() { pthread_mutex_init(&shim_lock, NULL); }
+
+__attribute__((constructor)) static void shim_init() {
+    pthread_atfork(shim_prepare, shim_parent, shim_child);
+}
+
+// mem_calloc_aligned skips clearing what the pool knows to be zero
+static void *shim_take(size_t alignment, size_t size, bool zero) {
+    return zero ? mem_calloc_aligned(alignment, 1, size)
+                : mem_alloc_aligned(alignment, size);
+}
+
+/// @brief allocates from the pool, setting it up on first use and growing it
+/// when full. Caller holds shim_lock
+/// @param alignment power of two
+/// @param size size in bytes
+/// @param zero clear the block
+/// @return NULL if the reservation is exhausted
+static void *shim_alloc(size_t alignment, size_t size, bool zero) {
+    if (!shim_ready) {
+        // good fit searches the size indexed free lists instead of walking
+        // every block, which aligned requests need as much as plain ones
+        mem_options opts = {.max_size = SHIM_RESERVE_SIZE,
+                            .policy = MEM_GOOD_FIT};
+        mem_init_opts(SHIM_INITIAL_SIZE, &opts);
+        shim_ready = true;
+    }
+    if (size == 0) size = 1;  // every malloc(0) must be unique
+    void *block = shim_take(alignment, size, zero);
+    if (block) return block;
+    size_t grow = size + alignment;
+    if (grow < SHIM_GROW_SIZE) grow = SHIM_GROW_SIZE;
+    if (!mem_grow(grow)) return NULL;
+    return shim_take(alignment, size, zero);
+}
+
+SHIM_EXPORT void *malloc(size_t size) {
+    pthread_mutex_lock(&shim_lock);
+    void *block = shim_alloc(SHIM_ALIGNMENT, size, false);
+    pthread_mutex_unlock(&shim_lock);
+    if (!block) errno = ENOMEM;
+    return block;
+}
+
+SHIM_EXPORT void free(void *block) {
+    if (!block) return;
+    pthread_mutex_lock(&shim_lock);
+    if (mem_owns(block)) mem_free(block);
+    pthread_mutex_unlock(&shim_lock);
+}
+
+SHIM_EXPORT void *calloc(size_t n, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(n, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    pthread_mutex_lock(&shim_lock);
+    void *block = shim_alloc(SHIM_ALIGNMENT, total, true);
+    pthread_mutex_unlock(&shim_lock);
+    if (!block) errno = ENOMEM;
+    return block;
+}
+
+SHIM_EXPORT void *realloc(void *block, size_t size) {
+    if (!block) return malloc(size);
+    if (size == 0) {
+        free(block);
+        return NULL;
+    }
+    pthread_mutex_lock(&shim_lock);
+    if (!mem_owns(block)) {
+        pthread_mutex_unlock(&shim_lock);
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t old_size = mem_usable_size(block);
+    if (old_size >= size) {
+        pthread_mutex_unlock(&shim_lock);
+        return block;
+    }
+    void *new_block = shim_alloc(SHIM_ALIGNMENT, size, false);
+    if (new_block) {
+        memcpy(new_block, block, old_size);
+        mem_free(block);
+    }
+    pthread_mutex_unlock(&shim_lock);
+    if (!new_block) errno = ENOMEM;
+    return new_block;
+}
+
+SHIM_EXPORT int posix_memalign(void **out, size_t alignment, size_t size) {
+    if (alignment % sizeof(void *) || (alignment & (alignment - 1)))
+        return EINVAL;
+    pthread_mutex_lock(&shim_lock);
+    void *block = shim_alloc(alignment, size, false);
+    pthread_mutex_unlock(&shim_lock);
+    if (!block) return ENOMEM;
+    *out = block;
+    return 0;
+}
+
+SHIM_EXPORT void *aligned_alloc(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alignment < SHIM_ALIGNMENT) alignment = SHIM_ALIGNMENT;
+    pthread_mutex_lock(&shim_lock);
+    void *block = shim_alloc(alignment, size, false);
+    pthread_mutex_unlock(&shim_lock);
+    if (!block) errno = ENOMEM;
+    return block;
+}
+
+SHIM_EXPORT void *memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+SHIM_EXPORT void *valloc(size_t size) {
+    return aligned_alloc(sysconf(_SC_PAGESIZE), size);
+}
+
+// like valloc, but the size is rounded up to whole pages too
+SHIM_EXPORT void *pvalloc(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    if (size > SIZE_MAX - page) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+SHIM_EXPORT size_t malloc_usable_size(void *block) {
+    pthread_mutex_lock(&shim_lock);
+    size_t size = mem_owns(block) ? mem_usable_size(block) : 0;
+    pthread_mutex_unlock(&shim_lock);
+    return size;
+}
@@ -1,20 +1,225 @@
+#define _GNU_SOURCE
 #include "memory_manager.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+
 void *memory_;
 void *memory_end;
+void *memory_limit;
 size_t space_left = 0;
 
+// bump allocator carved out of the pool, see mem_arena_init
+void *arena_start;
+void *arena_bump;
+void *arena_end;
+
 #define block_size_mask 0xfffffffC
 #define block_free_mask 1
+// the block ends in a 4 byte tag word, see mem_alloc_tagged
+#define block_tag_mask 2
+// both bits on a block that was freed but kept on a quick list, see
+// quick_push. It is neither used nor free until it is taken off again
+#define block_cached_mask (block_free_mask | block_tag_mask)
 #define align_size 4
-#define ALIGN(a) (a + align_size - 1) & ~(align_size - 1)
+#define ALIGN(a) (((a) + align_size - 1) & ~(size_t)(align_size - 1))
+#define arena_align 8
+// free blocks smaller than this have no room for their index links
+#define index_min_size 8
+#define bin_count 88
+#define link_none 0
+#define zero_range_count 32
+#define node_max 64
+// from linux/mempolicy.h
+#define mpol_preferred 1
+#define huge_page_size ((size_t)2 << 20)
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+// freed blocks at least this big hand their pages back to the kernel
+#define zero_release_size (64 << 10)
+#ifdef MEM_DEBUG
+// on each side of every block of the debug heap
+#define redzone_size 32
+// what the debug heap adds to a pool for the redzones, enough for a node
+// sized block in every 16 bytes
+#define debug_room(size) ((size) / 16 * 2 * redzone_size)
+// bytes callers can still have, charged what the blocks would take without
+// redzones so the pool holds what it would in a release build
+size_t debug_left;
+#else
+#define debug_room(size) 0
+#endif
 
 
 typedef uint32_t header;
 
+mem_policy policy = MEM_FIRST_FIT;
+size_t fit_limit;
+
+// the pool is one partition, or one per NUMA node. A used block of size 0
+// closes every partition but the last so free blocks never merge across
+typedef struct partition {
+    header *start;
+    void *end;
+    // MEM_NEXT_FIT, where the previous search left off
+    header *rover;
+    // MEM_BEST_FIT and MEM_GOOD_FIT, free blocks by size class, each a doubly
+    // linked list threaded through the payloads of the blocks
+    uint32_t bins[bin_count];
+    // set by mem_free since the index only merges forward
+    bool coalesce_pending;
+} partition;
+partition partitions[node_max];
+int partition_count;
+bool numa_enabled;
+
+// stretches of the pool known to hold nothing but zeros, pages that were
+// never touched or were handed back with MADV_DONTNEED. Forgetting one is
+// always safe, it only costs a memset in mem_calloc
+typedef struct zero_range {
+    void *start;
+    void *end;
+} zero_range;
+zero_range zero_ranges[zero_range_count];
+int zero_range_used;
+// granularity of partitions and of pages handed back, 2 MiB with huge pages
+size_t page_size;
+// the pool sits on MAP_HUGETLB pages rather than transparent ones
+bool pool_hugetlb;
+
+// A shared pool is preceded by the heap's state, which every process loads
+// into the globals above when it takes the lock and stores back before
+// letting go. Everything in it is relative to memory_ so the region can be
+// mapped anywhere. Shared pools have a single partition and no zero tracking
+#define shared_magic 0x5EA4ED01
+#define shared_meta_size 1024
+typedef struct shared_meta {
+    uint32_t magic;  // set once the creator is done setting up
+    pthread_mutex_t lock;
+    uint64_t end;
+    uint64_t space_left;
+    uint64_t rover;
+    uint64_t fit_limit;
+    mem_policy policy;
+    bool coalesce_pending;
+    uint32_t bins[bin_count];
+    uint32_t root;
+} shared_meta;
+_Static_assert(sizeof(shared_meta) <= shared_meta_size, "shared_meta too big");
+shared_meta *shared;
+int shared_fd = -1;
+// mem_set_root for private pools
+uint32_t root;
+
+// mem_free_deferred pushes blocks onto a lock-free stack, linked by the
+// mem_offset stored in their first bytes (in their debug_meta on the debug
+// heap, where a small block has fewer), and the reclaimer thread frees them.
+// Every heap operation on a private pool takes heap_mutex, so the thread can
+// start at any time without catching one halfway
+#define reclaim_batch 64
+// furthest a 32 bit mem_offset reaches, blocks of bigger pools are freed
+// right away instead
+#define deferred_reach ((uint64_t)UINT32_MAX * align_size)
+uint32_t deferred_head;
+size_t deferred_pending;  // pushed but not freed yet
+bool reclaimer_running;
+bool reclaimer_stop;
+pthread_t reclaimer;
+sem_t reclaimer_wake;
+pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Reclaim callbacks, see mem_reclaim_register. They run with the heap
+// unlocked, lowest priority first, when an allocation fails and when an
+// operation leaves fewer than pressure_watermark bytes free
+#define pressure_max 16
+typedef struct pressure_callback {
+    mem_reclaim_fn fn;
+    void *ctx;
+    int priority;
+} pressure_callback;
+pressure_callback pressure_callbacks[pressure_max];
+int pressure_count;
+size_t pressure_watermark;
+pthread_mutex_t pressure_mutex = PTHREAD_MUTEX_INITIALIZER;
+// how far below the watermark the calling thread's last operation left the
+// heap, set by heap_unlock
+__thread size_t heap_short;
+// a callback is running on this thread, its allocations don't reclaim
+__thread bool pressure_running;
+
+// A snapshot file is this header followed, from data_offset, by the pool. The
+// pool is mapped straight from the file on restore, copy on write
+#define snapshot_magic 0x4D4D5331
+typedef struct snapshot_partition {
+    uint64_t start;
+    uint64_t end;
+    uint64_t rover;
+    uint32_t bins[bin_count];
+    bool coalesce_pending;
+} snapshot_partition;
+typedef struct snapshot_header {
+    uint32_t magic;
+    int32_t partition_count;
+    uint64_t data_offset;  // a multiple of the page size
+    uint64_t size;
+    uint64_t base;  // memory_ when the snapshot was taken
+    uint64_t space_left;
+    uint64_t fit_limit;
+    mem_policy policy;
+    bool numa;
+    uint32_t root;
+    snapshot_partition partitions[node_max];
+} snapshot_header;
+// memory_ of the snapshot the pool was restored from, 0 if it wasn't
+uintptr_t snapshot_base;
+
+// Adaptive size classes, see mem_options.adaptive. Requests of up to
+// adapt_max_size bytes are counted by aligned size and every adapt_period
+// requests the sizes asked for most become the classes. A freed block of a
+// class size is marked cached on its class's quick list, linked through its
+// payload, and goes straight to the next request of that size
+#define adapt_max_size 256
+#define adapt_bins (adapt_max_size / align_size + 1)
+#define adapt_period 4096
+#define adapt_class_max 4
+// share of the counted requests, in percent, a size needs to become a class
+#define adapt_class_share 10
+// blocks kept per class, beyond that they are freed as usual
+#define quick_max 1024
+// the classes are heap block sizes, which the debug heap's redzones make
+// this much bigger than what callers asked for
+#ifdef MEM_DEBUG
+#define adapt_overhead (2 * redzone_size)
+#else
+#define adapt_overhead 0
+#endif
+bool adapt_enabled;
+uint64_t adapt_histogram[adapt_bins];
+uint32_t adapt_samples;  // since the classes were last derived
+size_t adapt_classes[adapt_class_max];
+int adapt_class_count;
+uint32_t quick_heads[adapt_class_max];
+size_t quick_lengths[adapt_class_max];
+
 size_t block_size(header *block) { return *block & block_size_mask; }
 
-bool block_isfree(header *block) { return *block & block_free_mask; }
+bool block_isfree(header *block) {
+    return (*block & block_cached_mask) == block_free_mask;
+}
+
+bool block_iscached(header *block) {
+    return (*block & block_cached_mask) == block_cached_mask;
+}
 
 void block_set_free(header *block, bool free) {
     if (free)
@@ -24,36 +229,1304 @@ void block_set_free(header *block, bool free) {
 }
 
 void block_set_size(header *block, uint32_t size) {
-    *block = (*block & 1) | size;
+    *block = (*block & ~block_size_mask) | size;
+}
+
+// per tag accounting for mem_alloc_tagged, a block is charged its whole
+// payload including the tag word
+mem_tag_stats tags[MEM_TAG_COUNT];
+
+uint32_t *tag_word(header *block) {
+    return (void *)(block + 1) + block_size(block) - sizeof(uint32_t);
+}
+
+/// @brief checks that size more bytes stay within the tag's limit, counting
+/// a failure if they don't
+bool tag_fits(int tag, size_t size) {
+    mem_tag_stats *account = &tags[tag];
+    if (!account->limit || account->live + size <= account->limit) return true;
+    account->failures++;
+    return false;
+}
+
+/// @brief marks a used block as belonging to tag and charges it
+void tag_set(header *block, int tag) {
+    mem_tag_stats *account = &tags[tag];
+    account->live += block_size(block);
+    if (account->live > account->peak) account->peak = account->live;
+    *block |= block_tag_mask;
+    *tag_word(block) = tag;
+}
+
+/// @brief gives a tagged block's bytes back to its tag, untagged blocks are
+/// left alone
+void tag_clear(header *block) {
+    if (!(*block & block_tag_mask)) return;
+    mem_tag_stats *account = &tags[*tag_word(block)];
+    size_t size = block_size(block);
+    // a restored pool starts with no accounting
+    account->live -= (size < account->live) ? size : account->live;
+    *block &= ~block_tag_mask;
+}
+
+/// @brief records that [start, end) holds only zeros
+void zero_add(void *start, void *end) {
+    if (start >= end) return;
+    for (int i = 0; i < zero_range_used; i++) {
+        if (zero_ranges[i].end == start) {
+            zero_ranges[i].end = end;
+            return;
+        }
+    }
+    if (zero_range_used == zero_range_count) return;
+    zero_ranges[zero_range_used++] = (zero_range){start, end};
+}
+
+/// @brief records that [start, end) may have been written to
+void zero_forget(void *start, void *end) {
+    for (int i = 0; i < zero_range_used; i++) {
+        zero_range *range = &zero_ranges[i];
+        if (range->end <= start || range->start >= end) continue;
+        if (range->start < start && range->end > end) {
+            void *tail = range->end;
+            range->end = start;
+            zero_add(end, tail);
+        } else if (range->start < start) {
+            range->end = start;
+        } else if (range->end > end) {
+            range->start = end;
+        } else {
+            *range = zero_ranges[--zero_range_used];
+            i--;
+        }
+    }
+}
+
+/// @brief zeroes the parts of [start, end) not already known to be zero
+void zero_claim(void *start, void *end) {
+    void *cursor = start;
+    while (cursor < end) {
+        void *skip_to = NULL;
+        void *next_zero = end;
+        for (int i = 0; i < zero_range_used; i++) {
+            zero_range *range = &zero_ranges[i];
+            if (range->start <= cursor && range->end > cursor) {
+                skip_to = range->end;
+                break;
+            }
+            if (range->start > cursor && range->start < next_zero)
+                next_zero = range->start;
+        }
+        if (skip_to) {
+            cursor = (skip_to < end) ? skip_to : end;
+        } else {
+            memset(cursor, 0, next_zero - cursor);
+            cursor = next_zero;
+        }
+    }
+    zero_forget(start, end);
+}
+
+/// @brief hands the whole pages inside a free payload back to the kernel,
+/// they read back as zeros
+void zero_release(void *start, void *end) {
+    // shared and file backed pages keep or get back their contents
+    if (shared || snapshot_base) return;
+    // the first bytes may hold index links
+    uintptr_t first = ((uintptr_t)start + 2 * sizeof(uint32_t) + page_size - 1) &
+                      ~(uintptr_t)(page_size - 1);
+    uintptr_t last = (uintptr_t)end & ~(uintptr_t)(page_size - 1);
+    if (first >= last) return;
+    if (madvise((void *)first, last - first, MADV_DONTNEED) == 0)
+        zero_add((void *)first, (void *)last);
+}
+
+/// @brief writes a fresh header, ignoring whatever was stored there before
+/// @param block where to place the header
+/// @param size payload size in bytes
+/// @param free
+void block_init(header *block, uint32_t size, bool free) {
+    zero_forget(block, block + 1);
+    *block = size | (free ? block_free_mask : 0);
 }
 
 uint32_t *block_get_next(header *block) {
     return ((void *)block) + (*block & block_size_mask) + sizeof(header);
 }
 
+/// @brief true if free blocks are tracked in the partition bins
+bool index_enabled() {
+    return policy == MEM_BEST_FIT || policy == MEM_GOOD_FIT;
+}
+
+/// @brief the size class of a block, exact below 256 bytes, then one per
+/// power of two
+int bin_of(size_t size) {
+    if (size < 256) return size / align_size;
+    return 56 + (63 - __builtin_clzll(size));
+}
+
+/// @brief pool relative name of a block, stored in units of align_size so a
+/// 32 bit link reaches 16 GiB
+uint32_t block_link(header *block) {
+    return ((void *)(block + 1) - memory_) / align_size;
+}
+
+header *link_block(uint32_t link) {
+    return memory_ + (size_t)link * align_size - sizeof(header);
+}
+
+/// @brief next and previous links of an indexed free block
+uint32_t *block_links(header *block) { return (uint32_t *)(block + 1); }
+
+/// @brief the partition a block lives in
+partition *partition_of(void *block) {
+    int i = partition_count - 1;
+    while (i > 0 && block < (void *)partitions[i].start) i--;
+    return &partitions[i];
+}
+
+/// @brief adds a free block to its size class
+void index_insert(header *block) {
+    if (!index_enabled() || block_size(block) < index_min_size) return;
+    uint32_t *bins = partition_of(block)->bins;
+    int bin = bin_of(block_size(block));
+    uint32_t *links = block_links(block);
+    zero_forget(links, links + 2);
+    links[0] = bins[bin];
+    links[1] = link_none;
+    if (bins[bin] != link_none)
+        block_links(link_block(bins[bin]))[1] = block_link(block);
+    bins[bin] = block_link(block);
+}
+
+/// @brief removes a free block from its size class, must be called before the
+/// size of the block changes
+void index_remove(header *block) {
+    if (!index_enabled() || block_size(block) < index_min_size) return;
+    uint32_t *links = block_links(block);
+    if (links[1] != link_none)
+        block_links(link_block(links[1]))[0] = links[0];
+    else
+        partition_of(block)->bins[bin_of(block_size(block))] = links[0];
+    if (links[0] != link_none) block_links(link_block(links[0]))[1] = links[1];
+}
+
+/// @brief moves the rover to block if it points at a header inside it that
+/// is about to stop existing
+void rover_fix(header *block, void *end) {
+    partition *part = partition_of(block);
+    if (part->rover > block && (void *)part->rover < end) part->rover = block;
+}
+
+#ifdef MEM_DEBUG
 /// @brief makes a qualified guess wether or not the block is valid, can never
 /// fail to identify a valid block
 /// @param block
 /// @return
 bool block_is_valid(header *block) {
-    while (block < memory_end) {
+    while ((void *)block < memory_end) {
         block = block_get_next(block);
         if (block == memory_end) return true;
     }
     return false;
 }
+#endif
+
+/// @brief merges the free blocks following block into it
+/// @param block a free block
+void block_merge_run(header *block) {
+    header *next = block_get_next(block);
+    if ((void *)next == memory_end || !block_isfree(next)) return;
+    size_t merged = block_size(block);
+    index_remove(block);
+    while ((void *)next != memory_end && block_isfree(next) &&
+           merged + sizeof(header) + block_size(next) <= block_size_mask) {
+        index_remove(next);
+        merged += sizeof(header) + block_size(next);
+        next = block_get_next(next);
+    }
+    block_set_size(block, merged);
+    index_insert(block);
+    rover_fix(block, next);
+}
+
+/// @brief merges every run of free blocks in the partition
+void partition_coalesce(partition *part) {
+    header *walker = part->start;
+    while ((void *)walker < part->end) {
+        if (block_isfree(walker)) block_merge_run(walker);
+        walker = block_get_next(walker);
+    }
+    part->coalesce_pending = false;
+}
+
+/// @brief marks a free block as used, splitting off what is left over as a
+/// new free block
+/// @param block free block with at least size bytes of payload
+/// @param size aligned size in bytes
+/// @return pointer to the payload
+void *block_take(header *block, size_t size) {
+    index_remove(block);
+    size_t available = block_size(block);
+    if (available >= size + sizeof(header)) {
+        block_set_size(block, size);
+        header *rest = block_get_next(block);
+        block_init(rest, available - size - sizeof(header), true);
+        index_insert(rest);
+    }
+    block_set_free(block, false);
+    space_left -= block_size(block);
+    if (policy == MEM_NEXT_FIT) partition_of(block)->rover = block_get_next(block);
+    return block + 1;
+}
+
+/// @brief bytes between the payload of a block and the first address in it
+/// that is a multiple of alignment
+size_t align_gap(header *block, size_t alignment) {
+    uintptr_t payload = (uintptr_t)(block + 1);
+    return ((payload + alignment - 1) & ~(alignment - 1)) - payload;
+}
+
+/// @brief true if size bytes starting on a multiple of alignment fit in the
+/// block
+bool block_fits(header *block, size_t size, size_t alignment) {
+    return block_size(block) >= size + align_gap(block, alignment);
+}
+
+/// @brief splits off the part of a free block in front of its first address
+/// that is a multiple of alignment
+/// @return the free block starting there
+header *block_align(header *block, size_t alignment) {
+    size_t gap = align_gap(block, alignment);
+    if (!gap) return block;
+    // the gap is a multiple of align_size so it can keep a header of its own
+    // and stay free
+    header *rest = (void *)block + gap;
+    index_remove(block);
+    block_init(rest, block_size(block) - gap, true);
+    block_set_size(block, gap - sizeof(header));
+    index_insert(block);
+    index_insert(rest);
+    return rest;
+}
+
+/// @brief first free block from start that fits, merging free runs on the way
+/// @param start block to start at
+/// @param stop where to give up
+/// @param size aligned size in bytes
+/// @param alignment power of two the payload has to start on
+header *find_first_fit(header *start, void *stop, size_t size, size_t alignment) {
+    header *walker = start;
+    while ((void *)walker < stop) {
+        if (block_isfree(walker)) {
+            block_merge_run(walker);
+            if (block_fits(walker, size, alignment)) return walker;
+        }
+        walker = block_get_next(walker);
+    }
+    return NULL;
+}
+
+/// @brief first fit, but starting where the previous search ended and
+/// wrapping around
+header *find_next_fit(partition *part, size_t size, size_t alignment) {
+    header *start = ((void *)part->rover < part->end) ? part->rover : part->start;
+    header *block = find_first_fit(start, part->end, size, alignment);
+    if (!block && start != part->start)
+        block = find_first_fit(part->start, start, size, alignment);
+    return block;
+}
+
+/// @brief smallest indexed block that fits, looking at no more than limit
+/// fitting blocks
+header *find_indexed(partition *part, size_t size, size_t alignment,
+                     size_t limit) {
+    header *best = NULL;
+    size_t seen = 0;
+    // from this class on the gap always fits, below it most blocks would be
+    // looked at only to be turned down
+    size_t wanted = size + alignment - align_size;
+    for (int bin = bin_of(wanted); bin < bin_count; bin++) {
+        uint32_t link = part->bins[bin];
+        while (link != link_none) {
+            header *block = link_block(link);
+            link = block_links(block)[0];
+            if (!block_fits(block, size, alignment)) continue;
+            if (!best || block_size(block) < block_size(best)) best = block;
+            if (block_size(best) == size + align_gap(best, alignment) ||
+                ++seen >= limit)
+                return best;
+        }
+        // every later class only holds bigger blocks
+        if (best) return best;
+    }
+    return NULL;
+}
+
+/// @brief finds a free block in the partition according to policy
+/// @param size aligned size in bytes
+/// @param alignment power of two the payload has to start on, the block
+/// holds size bytes from there
+header *partition_find(partition *part, size_t size, size_t alignment) {
+    switch (policy) {
+        case MEM_NEXT_FIT:
+            return find_next_fit(part, size, alignment);
+        case MEM_BEST_FIT:
+        case MEM_GOOD_FIT: {
+            size_t limit = (policy == MEM_BEST_FIT) ? SIZE_MAX : fit_limit;
+            header *block = find_indexed(part, size, alignment, limit);
+            if (!block && part->coalesce_pending) {
+                partition_coalesce(part);
+                block = find_indexed(part, size, alignment, limit);
+            }
+            return block;
+        }
+        default:
+            return find_first_fit(part->start, part->end, size, alignment);
+    }
+}
+
+/// @brief the NUMA node the calling thread runs on
+int current_node() {
+    unsigned int cpu, node;
+    if (getcpu(&cpu, &node) != 0) return 0;
+    return node % partition_count;
+}
+
+/// @brief finds a free block of at least size bytes, on the calling thread's
+/// node first
+/// @param size aligned size in bytes
+/// @param alignment power of two the payload has to start on
+/// @param node partition to search, -1 for any
+header *heap_find(size_t size, size_t alignment, int node) {
+    if (node >= 0) return partition_find(&partitions[node], size, alignment);
+    int home = numa_enabled ? current_node() : 0;
+    for (int i = 0; i < partition_count; i++) {
+        header *block =
+            partition_find(&partitions[(home + i) % partition_count], size,
+                           alignment);
+        if (block) return block;
+    }
+    return NULL;
+}
+
+/// @brief lays out [start, end) as free blocks no larger than a header can
+/// describe
+void region_format(void *start, void *end) {
+    while (start < end) {
+        size_t size = end - start - sizeof(header);
+        if (size > block_size_mask) size = block_size_mask;
+        block_init(start, size, true);
+        index_insert(start);
+        start += size + sizeof(header);
+    }
+}
+
+/// @brief number of NUMA nodes the kernel reports, 1 if it can't tell
+int numa_node_count() {
+    // read rather than fopen, the pool may be what backs malloc
+    char buffer[256];
+    int fd = open("/sys/devices/system/node/online", O_RDONLY);
+    if (fd < 0) return 1;
+    ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (length <= 0) return 1;
+    buffer[length] = 0;
+    // a list such as 0-1,3, the highest node comes last
+    int highest = 0, number = 0;
+    for (char *c = buffer; *c; c++) {
+        if (*c >= '0' && *c <= '9') {
+            number = number * 10 + (*c - '0');
+            if (number > highest) highest = number;
+        } else {
+            number = 0;
+        }
+    }
+    return highest + 1;
+}
+
+/// @brief asks the kernel to place the pages of [start, start + size) on
+/// node, the pool works the same if it refuses
+void numa_bind(void *start, size_t size, int node) {
+    unsigned long mask = 1UL << node;
+    syscall(SYS_mbind, start, size, mpol_preferred, &mask, sizeof(mask) * 8, 0);
+}
+
+/// @brief maps the pool, on 2 MiB pages if huge is set and the kernel has
+/// any: reserved hugetlb pages first, transparent huge pages otherwise
+/// @param size size in bytes, rounded up to the page size that was used
+/// @param huge
+/// @return MAP_FAILED on failure
+void *pool_map(size_t *size, bool huge) {
+    int protection = PROT_READ | PROT_WRITE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    pool_hugetlb = false;
+    if (!huge) return mmap(NULL, *size, protection, flags | MAP_NORESERVE, -1, 0);
+
+    size_t huge_size = (*size + huge_page_size - 1) & ~(huge_page_size - 1);
+    // no MAP_NORESERVE, running out of hugetlb pages later would be a SIGBUS
+    void *pool = mmap(NULL, huge_size, protection, flags | MAP_HUGETLB, -1, 0);
+    if (pool != MAP_FAILED) {
+        pool_hugetlb = true;
+        *size = huge_size;
+        return pool;
+    }
+    // over-map so a 2 MiB aligned stretch can be cut out of it
+    void *raw = mmap(NULL, huge_size + huge_page_size, protection,
+                     flags | MAP_NORESERVE, -1, 0);
+    if (raw == MAP_FAILED) return raw;
+    pool = (void *)(((uintptr_t)raw + huge_page_size - 1) &
+                    ~(uintptr_t)(huge_page_size - 1));
+    if (pool > raw) munmap(raw, pool - raw);
+    void *raw_end = raw + huge_size + huge_page_size;
+    if (pool + huge_size < raw_end)
+        munmap(pool + huge_size, raw_end - (pool + huge_size));
+    madvise(pool, huge_size, MADV_HUGEPAGE);
+    *size = huge_size;
+    return pool;
+}
+
+/// @brief faults in [start, end) up front so page faults stay off the
+/// allocation path
+void pool_prefault(void *start, void *end) {
+    if (madvise(start, end - start, MADV_POPULATE_WRITE) == 0) return;
+    // older kernels, writing the zeros that are already there works too
+    size_t step = sysconf(_SC_PAGESIZE);
+    for (volatile char *page = start; (void *)page < end; page += step)
+        *page = *page;
+}
+
+/// @brief takes the shared pool's lock and loads its state, does nothing for
+/// private pools
+void shared_lock() {
+    if (!shared) return;
+    if (pthread_mutex_lock(&shared->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(&shared->lock);
+    partition *part = &partitions[0];
+    memory_end = part->end = memory_ + shared->end;
+    space_left = shared->space_left;
+    part->rover = memory_ + shared->rover;
+    part->coalesce_pending = shared->coalesce_pending;
+    memcpy(part->bins, shared->bins, sizeof(part->bins));
+}
+
+/// @brief stores the state for the other processes and lets go of the lock
+void shared_unlock() {
+    if (!shared) return;
+    partition *part = &partitions[0];
+    shared->end = memory_end - memory_;
+    shared->space_left = space_left;
+    shared->rover = (void *)part->rover - memory_;
+    shared->coalesce_pending = part->coalesce_pending;
+    memcpy(shared->bins, part->bins, sizeof(part->bins));
+    pthread_mutex_unlock(&shared->lock);
+}
+
+/// @brief takes the lock needed before touching the heap: the shared pool's,
+/// or the private one the reclaimer thread frees under
+void heap_lock() {
+    if (shared)
+        shared_lock();
+    else
+        pthread_mutex_lock(&heap_mutex);
+}
+
+void heap_unlock() {
+    size_t left = space_left;
+#ifdef MEM_DEBUG
+    if (debug_left < left) left = debug_left;
+#endif
+    heap_short = (left < pressure_watermark) ? pressure_watermark - left : 0;
+    if (shared)
+        shared_unlock();
+    else
+        pthread_mutex_unlock(&heap_mutex);
+}
+
+/// @brief runs the reclaim callbacks from *next on until one frees something
+/// @param wanted bytes the heap is short of
+/// @param next first callback to run, moved past the ones run
+/// @return false if none of them freed anything
+bool pressure_next(int *next, size_t wanted) {
+    if (pressure_running) return false;
+    pressure_running = true;
+    size_t freed = 0;
+    while (!freed) {
+        pthread_mutex_lock(&pressure_mutex);
+        bool more = *next < pressure_count;
+        pressure_callback callback = more ? pressure_callbacks[*next]
+                                          : (pressure_callback){0};
+        pthread_mutex_unlock(&pressure_mutex);
+        if (!more) break;
+        (*next)++;
+        freed = callback.fn(wanted, callback.ctx);
+    }
+    pressure_running = false;
+    return freed;
+}
+
+/// @brief called with the heap unlocked after every attempt to allocate.
+/// A failed attempt gets the next callback that frees something and is
+/// repeated, a successful one that left the heap under the watermark runs
+/// callbacks until it is back above it
+/// @param failed the attempt returned nothing
+/// @param size bytes the attempt needed
+/// @param next callbacks run for this allocation so far, start at 0
+/// @return true if the attempt is worth repeating
+bool pressure_retry(bool failed, size_t size, int *next) {
+    if (failed) return pressure_next(next, size);
+    for (int all = 0; heap_short && pressure_next(&all, heap_short);) {
+        // measure again
+        heap_lock();
+        heap_unlock();
+    }
+    return false;
+}
+
+/// @brief opens the shared region, creating and sizing it if it is new
+/// @param size bytes for a new region
+/// @param created set if this call made the region
+/// @return file descriptor, -1 on failure
+int shared_open(const char *name, size_t size, bool *created) {
+    *created = true;
+    int fd = name ? shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)
+                  : memfd_create("memory_manager", 0);
+    if (fd < 0 && name && errno == EEXIST) {
+        *created = false;
+        return shm_open(name, O_RDWR, 0);
+    }
+    if (fd >= 0 && ftruncate(fd, size) != 0) {
+        close(fd);
+        if (name) shm_unlink(name);
+        return -1;
+    }
+    return fd;
+}
+
+/// @brief mem_init_opts for mem_options.shared
+void shared_init(size_t size, const mem_options *opts) {
+    size = ALIGN(size);
+    size_t region_size = shared_meta_size + size + sizeof(header);
+    bool created;
+    int fd = shared_open(opts->shared_name, region_size, &created);
+    if (fd < 0) return;
+    struct stat st = {0};
+    // wait for the creator to size the region
+    for (int tries = 0; !created && tries < 1000; tries++) {
+        if (fstat(fd, &st) == 0 && st.st_size > shared_meta_size) break;
+        usleep(1000);
+    }
+    if (!created) region_size = st.st_size;
+    if (region_size <= shared_meta_size + sizeof(header)) {
+        close(fd);
+        return;
+    }
+    void *region = mmap(NULL, region_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        fd, 0);
+    if (region == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+    shared = region;
+    shared_fd = fd;
+    memory_ = region + shared_meta_size;
+    memory_end = memory_limit = region + region_size;
+    page_size = sysconf(_SC_PAGESIZE);
+    partition_count = 1;
+    numa_enabled = false;
+    pool_hugetlb = false;
+    zero_range_used = 0;
+    partition *part = &partitions[0];
+    memset(part, 0, sizeof(*part));
+    part->start = part->rover = memory_;
+    part->end = memory_end;
+#ifdef MEM_DEBUG
+    // the other processes allocate from it too, only the pool itself limits
+    debug_left = SIZE_MAX / 2;
+#endif
+    if (!created) {
+        for (int tries = 0; tries < 1000; tries++) {
+            if (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) == shared_magic)
+                break;
+            usleep(1000);
+        }
+        policy = shared->policy;
+        fit_limit = shared->fit_limit;
+        return;
+    }
+    policy = shared->policy = opts->policy;
+    fit_limit = shared->fit_limit = opts->fit_limit ? opts->fit_limit : 8;
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shared->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    region_format(memory_, memory_end);
+    space_left = size;
+    shared->root = 0;
+    pthread_mutex_lock(&shared->lock);
+    shared_unlock();
+    __atomic_store_n(&shared->magic, shared_magic, __ATOMIC_RELEASE);
+}
 
 /// @brief loads up the memory with memory
 /// @param size size in bytes
-void mem_init(size_t size) {
+void mem_init(size_t size) { mem_init_opts(size, NULL); }
+
+/// @brief loads up the memory with memory, see mem_options
+/// @param size size in bytes
+/// @param opts NULL for the defaults
+void mem_init_opts(size_t size, const mem_options *opts) {
+    if (opts && opts->shared) {
+        shared_init(size, opts);
+        return;
+    }
     size = ALIGN(size);
+#ifdef MEM_DEBUG
+    debug_left = size;
+#endif
+    size += debug_room(size);
     size_t total_size = size + sizeof(header) * 17;
-    memory_ = malloc(total_size);
+    bool huge = opts && opts->huge_pages;
+    page_size = huge ? huge_page_size : (size_t)sysconf(_SC_PAGESIZE);
+    partition_count = 1;
+    numa_enabled = opts && opts->numa;
+    if (numa_enabled) {
+        partition_count = opts->numa_nodes ? opts->numa_nodes : numa_node_count();
+        if (partition_count < 1) partition_count = 1;
+        if (partition_count > node_max) partition_count = node_max;
+        // page aligned partitions so each can be bound on its own
+        size_t part_size = total_size / partition_count + sizeof(header);
+        part_size = (part_size + page_size - 1) & ~(page_size - 1);
+        total_size = part_size * partition_count;
+    }
+    size_t reserve_size = total_size;
+    size_t max_size = opts ? ALIGN(opts->max_size) : 0;
+    max_size += debug_room(max_size);
+    if (max_size > size) reserve_size = max_size + sizeof(header) * 17;
+    if (reserve_size < total_size) reserve_size = total_size;
+    // mmap rather than malloc so the pool can back malloc itself
+    memory_ = pool_map(&reserve_size, huge);
+    if (memory_ == MAP_FAILED) {
+        memory_ = memory_end = memory_limit = NULL;
+        space_left = 0;
+        return;
+    }
     memory_end = memory_ + total_size;
-    header *initial_block = memory_;
-    block_set_size(initial_block, total_size - sizeof(header));
-    block_set_free(initial_block, true);
+    memory_limit = memory_ + reserve_size;
+    policy = opts ? opts->policy : MEM_FIRST_FIT;
+    fit_limit = (opts && opts->fit_limit) ? opts->fit_limit : 8;
+    // links can't name blocks beyond 16 GiB
+    if (index_enabled() && reserve_size / align_size > UINT32_MAX)
+        policy = MEM_FIRST_FIT;
+    // fresh anonymous pages are zero, including the part kept for mem_grow
+    zero_range_used = 0;
+    zero_add(memory_, memory_limit);
+    size_t part_size = total_size / partition_count;
+    for (int i = 0; i < partition_count; i++) {
+        partition *part = &partitions[i];
+        memset(part, 0, sizeof(*part));
+        part->start = memory_ + i * part_size;
+        part->end = (i == partition_count - 1) ? memory_end
+                                               : memory_ + (i + 1) * part_size;
+        part->rover = part->start;
+        // bind before the first header touches the pages
+        if (numa_enabled) numa_bind(part->start, part_size, i);
+        if (i < partition_count - 1) {
+            region_format(part->start, part->end - sizeof(header));
+            block_init(part->end - sizeof(header), 0, false);
+        } else {
+            region_format(part->start, part->end);
+        }
+    }
+    if (opts && opts->prefault) pool_prefault(memory_, memory_end);
     space_left = size;
+    adapt_enabled = opts && opts->adaptive;
+}
+
+/// @brief extends the pool in place, only possible if mem_options.max_size
+/// reserved room for it
+/// @param size size in bytes
+/// @return false if the reservation is exhausted
+bool mem_grow(size_t size) {
+    size = ALIGN(size);
+#ifdef MEM_DEBUG
+    size_t asked = size;
+#endif
+    size += debug_room(size);
+    if (memory_ == NULL || shared || size > block_size_mask) return false;
+    heap_lock();
+    bool grown = memory_end + size + sizeof(header) <= memory_limit;
+#ifdef MEM_DEBUG
+    if (grown) debug_left += asked;
+#endif
+    if (grown) {
+        block_init(memory_end, size, true);
+        memory_end += size + sizeof(header);
+        partitions[partition_count - 1].end = memory_end;
+        index_insert(memory_end - size - sizeof(header));
+        space_left += size;
+    }
+    heap_unlock();
+    return grown;
+}
+
+/// @brief marks a used block free and hands it to the free block index
+/// @param block_header an untagged used block
+void heap_release(header *block_header) {
+    void *block = block_header + 1;
+    block_set_free(block_header, true);
+    space_left += block_size(block_header);
+    if (block_size(block_header) >= zero_release_size)
+        zero_release(block, block + block_size(block_header));
+    index_insert(block_header);
+    if (index_enabled()) {
+        block_merge_run(block_header);
+        partition_of(block_header)->coalesce_pending = true;
+    }
+}
+
+/// @brief the class of an aligned size, -1 if it has none
+int adapt_class_of(size_t size) {
+    for (int i = 0; i < adapt_class_count; i++)
+        if (adapt_classes[i] == size) return i;
+    return -1;
+}
+
+/// @brief frees every block kept on the quick lists
+/// @return false if there were none
+bool quick_drain() {
+    bool drained = false;
+    for (int i = 0; i < adapt_class_count; i++) {
+        uint32_t link = quick_heads[i];
+        quick_heads[i] = link_none;
+        quick_lengths[i] = 0;
+        while (link != link_none) {
+            header *block = link_block(link);
+            link = block_links(block)[0];
+            *block &= ~block_cached_mask;
+            heap_release(block);
+            drained = true;
+        }
+    }
+    return drained;
+}
+
+/// @brief keeps a block being freed on the quick list of its size
+/// @return false if its size has no class or the list is full
+bool quick_push(header *block) {
+    if (!adapt_enabled) return false;
+    int class = adapt_class_of(block_size(block));
+    if (class < 0 || quick_lengths[class] == quick_max) return false;
+    block_links(block)[0] = quick_heads[class];
+    quick_heads[class] = block_link(block);
+    quick_lengths[class]++;
+    *block |= block_cached_mask;
+    return true;
+}
+
+/// @brief makes the sizes with the most requests in the histogram the
+/// classes, keeping the quick lists of classes that stay
+void adapt_derive() {
+    uint64_t total = 0;
+    for (int bin = 0; bin < adapt_bins; bin++) total += adapt_histogram[bin];
+    size_t classes[adapt_class_max];
+    uint32_t heads[adapt_class_max] = {0};
+    size_t lengths[adapt_class_max] = {0};
+    int count = 0;
+    while (count < adapt_class_max) {
+        int best = 0;
+        for (int bin = 1; bin < adapt_bins; bin++) {
+            bool taken = false;
+            for (int i = 0; i < count; i++)
+                taken |= classes[i] == (size_t)bin * align_size;
+            if (!taken && adapt_histogram[bin] > adapt_histogram[best]) best = bin;
+        }
+        if (!best || adapt_histogram[best] * 100 < total * adapt_class_share)
+            break;
+        classes[count++] = (size_t)best * align_size;
+    }
+    for (int i = 0; i < count; i++) {
+        int class = adapt_class_of(classes[i]);
+        if (class < 0) continue;
+        heads[i] = quick_heads[class];
+        lengths[i] = quick_lengths[class];
+        quick_heads[class] = link_none;
+        quick_lengths[class] = 0;
+    }
+    quick_drain();
+    memcpy(adapt_classes, classes, count * sizeof(size_t));
+    memcpy(quick_heads, heads, sizeof(heads));
+    memcpy(quick_lengths, lengths, sizeof(lengths));
+    adapt_class_count = count;
+}
+
+/// @brief counts a request and takes a block for it off its class's quick
+/// list. Every adapt_period requests the classes are derived again and the
+/// histogram halved, so sizes that are no longer asked for fade out
+/// @param size aligned size in bytes
+/// @param node partition to allocate from, -1 for any
+/// @return a used block, NULL if the quick list is empty
+header *adapt_alloc(size_t size, int node) {
+    if (size <= adapt_max_size) adapt_histogram[size / align_size]++;
+    if (++adapt_samples == adapt_period) {
+        adapt_derive();
+        for (int bin = 0; bin < adapt_bins; bin++) adapt_histogram[bin] /= 2;
+        adapt_samples = 0;
+    }
+    int class = adapt_class_of(size);
+    // quick lists don't keep track of partitions
+    if (class < 0 || node >= 0 || quick_heads[class] == link_none) return NULL;
+    header *block = link_block(quick_heads[class]);
+    quick_heads[class] = block_links(block)[0];
+    quick_lengths[class]--;
+    *block &= ~block_cached_mask;
+    return block;
+}
+
+/// @brief allocates a block, bytes from zero_from onwards come back zeroed
+/// @param size size in bytes
+/// @param zero_from offset into the block, SIZE_MAX to zero nothing
+/// @param node partition to allocate from, -1 for any
+void *heap_alloc(size_t size, size_t zero_from, int node) {
+    if(size == 0) return memory_ + sizeof(header);
+    size_t aligned = ALIGN(size);
+    header *found = adapt_enabled ? adapt_alloc(aligned, node) : NULL;
+    if (found) {
+        void *block = found + 1;
+        if (zero_from < size) zero_claim(block + zero_from, block + size);
+        return block;
+    }
+    if (size <= space_left) found = heap_find(aligned, align_size, node);
+    // the quick lists may hold what it takes
+    if (!found && quick_drain() && size <= space_left)
+        found = heap_find(aligned, align_size, node);
+    if (!found) return NULL;
+    void *block = block_take(found, aligned);
+    if (zero_from < size) zero_claim(block + zero_from, block + size);
+    zero_forget(block, block + aligned);
+    return block;
+}
+
+/// @brief heap_alloc, but the block starts on a multiple of alignment
+/// @param alignment power of two
+/// @param size size in bytes
+/// @param zero_from offset into the block, SIZE_MAX to zero nothing
+void *heap_alloc_aligned(size_t alignment, size_t size, size_t zero_from) {
+    if (alignment <= align_size) return heap_alloc(size, zero_from, -1);
+    size_t aligned = ALIGN(size);
+    header *found = NULL;
+    if (size <= space_left) found = heap_find(aligned, alignment, -1);
+    // the quick lists may hold what it takes
+    if (!found && quick_drain() && size <= space_left)
+        found = heap_find(aligned, alignment, -1);
+    if (!found) return NULL;
+    void *block = block_take(block_align(found, alignment), aligned);
+    if (zero_from < size) zero_claim(block + zero_from, block + size);
+    zero_forget(block, block + aligned);
+    return block;
+}
+
+/// @brief gives a block back to the pool, trusting that it came from it
+/// @param block block to free
+void heap_free(void *block) {
+    header *block_header = block - sizeof(header);
+    // already free, or freed and kept on a quick list
+    if (*block_header & block_free_mask) return;
+    tag_clear(block_header);
+    if (!quick_push(block_header)) heap_release(block_header);
+}
+
+int block_address_cmp(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t) * (void *const *)a;
+    uintptr_t y = (uintptr_t) * (void *const *)b;
+    return (x > y) - (x < y);
+}
+
+/// @brief heap_free for many blocks at once, merging every run they free in
+/// one go instead of block by block
+/// @param blocks blocks to free, sorted by address in place, NULL and arena
+/// blocks are skipped
+void heap_free_batch(void **blocks, size_t count) {
+    qsort(blocks, count, sizeof(void *), block_address_cmp);
+    for (size_t i = 0; i < count; i++) {
+        void *block = blocks[i];
+        if (!block || (block >= arena_start && block < arena_end)) continue;
+        header *block_header = block - sizeof(header);
+        if (*block_header & block_free_mask) continue;
+        tag_clear(block_header);
+        block_set_free(block_header, true);
+        space_left += block_size(block_header);
+        if (block_size(block_header) >= zero_release_size)
+            zero_release(block, block + block_size(block_header));
+        index_insert(block_header);
+    }
+    // lowest address first, so each run is merged from its first block
+    void *merged_end = NULL;
+    for (size_t i = 0; i < count; i++) {
+        void *block = blocks[i];
+        if (!block || block < merged_end) continue;
+        if (block >= arena_start && block < arena_end) continue;
+        header *block_header = block - sizeof(header);
+        block_merge_run(block_header);
+        merged_end = block_get_next(block_header);
+        if (index_enabled()) partition_of(block_header)->coalesce_pending = true;
+    }
+}
+
+/// @brief carves count blocks of size bytes back to back out of as few free
+/// blocks as possible, searching once per free block used rather than once
+/// per block
+/// @param out receives the blocks
+/// @return false if they don't all fit, nothing is allocated then
+bool heap_alloc_batch(size_t size, size_t count, void **out) {
+    if (size == 0) {
+        for (size_t i = 0; i < count; i++) out[i] = memory_ + sizeof(header);
+        return true;
+    }
+    size_t aligned = ALIGN(size);
+    size_t stride = aligned + sizeof(header);
+    // the quick lists count as used until they are drained
+    if (count > space_left / aligned) quick_drain();
+    if (count > space_left / aligned) return false;
+    size_t done = 0;
+    while (done < count) {
+        header *found = heap_find(aligned, align_size, -1);
+        if (!found && quick_drain()) found = heap_find(aligned, align_size, -1);
+        if (!found) break;
+        index_remove(found);
+        size_t available = block_size(found) + sizeof(header);
+        size_t fit = available / stride;
+        if (fit > count - done) fit = count - done;
+        header *block = found;
+        zero_forget(found, (void *)found + fit * stride);
+        for (size_t i = 0; i < fit; i++) {
+            *block = aligned;
+            out[done++] = block + 1;
+            block = (void *)block + stride;
+        }
+        // both are multiples of align_size, so anything left holds a header
+        if (available > fit * stride) {
+            block_init(block, available - fit * stride - sizeof(header), true);
+            index_insert(block);
+        }
+        space_left -= fit * aligned;
+        if (policy == MEM_NEXT_FIT) partition_of(found)->rover = block;
+    }
+    if (done == count) return true;
+    heap_free_batch(out, done);
+    return false;
+}
+
+/// @brief mem_resize, optionally zeroing everything past the old size
+void *heap_resize(void *block, size_t size, bool zero) {
+    if (block == NULL) return heap_alloc(size, zero ? 0 : SIZE_MAX, -1);
+    if (size == 0) {
+        heap_free(block);
+        return NULL;
+    }
+    header *block_header = block - sizeof(header);
+    size_t old_size = block_size(block_header);
+    size_t new_size = ALIGN(size);
+    size_t available = old_size;
+    header *next = block_get_next(block_header);
+    if (new_size > old_size && (void *)next != memory_end && block_isfree(next)) {
+        // grow into the free blocks right after it
+        block_merge_run(next);
+        size_t combined = old_size + sizeof(header) + block_size(next);
+        if (combined >= new_size && combined <= block_size_mask &&
+            new_size - old_size <= space_left) {
+            index_remove(next);
+            rover_fix(block_header, block_get_next(next));
+            available = combined;
+        }
+    }
+    if (new_size > available) {
+        void *new_block = heap_alloc(size, zero ? old_size : SIZE_MAX, -1);
+        if (!new_block) return NULL;
+        memcpy(new_block, block, old_size);
+        heap_free(block);
+        return new_block;
+    }
+    block_set_size(block_header, available);
+    if (new_size > old_size) {
+        if (zero) zero_claim(block + old_size, block + size);
+        zero_forget(block + old_size, block + new_size);
+    }
+    if (available >= new_size + sizeof(header)) {
+        // give back the tail
+        block_set_size(block_header, new_size);
+        header *rest = block_get_next(block_header);
+        block_init(rest, available - new_size - sizeof(header), true);
+        index_insert(rest);
+        block_merge_run(rest);
+    }
+    space_left = space_left + old_size - block_size(block_header);
+    return block;
+}
+
+#ifndef MEM_DEBUG
+/// @brief the header of the block a pointer from mem_alloc lives in
+header *user_header(void *block) { return block - sizeof(header); }
+#endif
+
+#ifdef MEM_DEBUG
+// Debug heap: every block sits between redzones that are checked when it is
+// freed, freed blocks are poisoned and kept in a quarantine before they go
+// back to the pool so writes through stale pointers can be caught too
+#define redzone_byte 0xFA
+#define poison_byte 0xDD
+#define quarantine_count 64
+#define debug_live 0xA110CA7E
+#define debug_freed 0xF4EEF4EE
+
+// kept redzone_size bytes in front of the block, with redzone on both sides
+// and state last so that an underflow long enough to reach it gets the block
+// rejected rather than misread
+typedef struct debug_meta {
+    uint32_t size;      // bytes asked for
+    uint32_t front;     // bytes from the start of the real block
+    uint32_t deferred;  // next block on the deferred stack
+    uint32_t state;
+} debug_meta;
+
+header *user_header(void *block) {
+    debug_meta *meta = block - redzone_size;
+    return block - meta->front - sizeof(header);
+}
+
+void *quarantine[quarantine_count];
+int quarantine_next;
+size_t debug_errors;
+
+void debug_report(const char *op, const char *what, void *block) {
+    fprintf(stderr, "%s: %s at %p\n", op, what, block);
+    debug_errors++;
+}
+
+void debug_drain();
+
+/// @brief allocates size bytes wrapped in redzones
+/// @param alignment power of two
+/// @param zero clear the bytes handed out
+/// @param node partition to allocate from, -1 for any
+void *debug_alloc(size_t size, size_t alignment, bool zero, int node) {
+    if (ALIGN(size) > debug_left) return NULL;
+    size_t front = (alignment > redzone_size) ? alignment : redzone_size;
+    size_t inner_size = front + size + redzone_size;
+    void *inner = NULL;
+    // the second time round with the room the quarantine was holding
+    for (int pass = 0; !inner && pass < 2; pass++) {
+        if (pass) debug_drain();
+        inner = (alignment > align_size)
+                    ? heap_alloc_aligned(alignment, inner_size,
+                                         zero ? front : SIZE_MAX)
+                    : heap_alloc(inner_size, zero ? front : SIZE_MAX, node);
+    }
+    if (!inner) return NULL;
+    debug_left -= ALIGN(size);
+    void *block = inner + front;
+    debug_meta *meta = block - redzone_size;
+    memset(inner, redzone_byte, front);
+    meta->state = debug_live;
+    meta->front = front;
+    meta->size = size;
+    void *end = inner + block_size(inner - sizeof(header));
+    memset(block + size, redzone_byte, end - (block + size));
+    return block;
+}
+
+/// @brief checks that block is live and both of its redzones are intact
+/// @param op reported along with any error
+/// @return the block's metadata, NULL if it can't be used
+debug_meta *debug_check(void *block, const char *op) {
+    if (!mem_owns(block) ||
+        block < memory_ + sizeof(header) + redzone_size) {
+        debug_report(op, "pointer outside the pool", block);
+        return NULL;
+    }
+    debug_meta *meta = block - redzone_size;
+    if (meta->state == debug_freed) {
+        debug_report(op, "double free", block);
+        return NULL;
+    }
+    void *inner = block - meta->front;
+    if (meta->state != debug_live || !block_is_valid(inner - sizeof(header))) {
+        debug_report(op, "pointer to no block", block);
+        return NULL;
+    }
+    for (unsigned char *byte = inner; byte < (unsigned char *)block; byte++) {
+        if (byte == (unsigned char *)meta) byte += sizeof(debug_meta);
+        if (*byte != redzone_byte) {
+            debug_report(op, "buffer underflow", block);
+            break;
+        }
+    }
+    header *inner_header = inner - sizeof(header);
+    unsigned char *end = inner + block_size(inner_header);
+    if (*inner_header & block_tag_mask) end -= sizeof(uint32_t);
+    for (unsigned char *byte = block + meta->size; byte < end; byte++) {
+        if (*byte != redzone_byte) {
+            debug_report(op, "buffer overflow", block);
+            break;
+        }
+    }
+    return meta;
+}
+
+/// @brief releases a block leaving the quarantine, checking nobody wrote to
+/// it in the meantime
+void debug_evict(void *block) {
+    debug_meta *meta = block - redzone_size;
+    for (unsigned char *byte = block; byte < (unsigned char *)block + meta->size;
+         byte++) {
+        if (*byte != poison_byte) {
+            debug_report("mem_free", "write after free", block);
+            break;
+        }
+    }
+    heap_free(block - meta->front);
+}
+
+void debug_free(void *block) {
+    debug_meta *meta = debug_check(block, "mem_free");
+    if (!meta) return;
+    memset(block, poison_byte, meta->size);
+    meta->state = debug_freed;
+    debug_left += ALIGN(meta->size);
+    tag_clear(user_header(block));
+    if (quarantine[quarantine_next]) debug_evict(quarantine[quarantine_next]);
+    quarantine[quarantine_next] = block;
+    quarantine_next = (quarantine_next + 1) % quarantine_count;
+}
+
+/// @brief always moves the block so stale pointers to the old one show up
+void *debug_resize(void *block, size_t size, bool zero) {
+    if (block == NULL) return debug_alloc(size, align_size, zero, -1);
+    if (size == 0) {
+        debug_free(block);
+        return NULL;
+    }
+    debug_meta *meta = debug_check(block, "mem_resize");
+    if (!meta) return NULL;
+    // charged as if it grew in place, the old block goes right after
+    debug_left += ALIGN(meta->size);
+    void *new_block = debug_alloc(size, align_size, false, -1);
+    debug_left -= ALIGN(meta->size);
+    if (!new_block) return NULL;
+    size_t old_size = meta->size;
+    memcpy(new_block, block, (old_size < size) ? old_size : size);
+    if (zero && size > old_size) memset(new_block + old_size, 0, size - old_size);
+    debug_free(block);
+    return new_block;
+}
+
+/// @brief checks and empties the quarantine
+void debug_drain() {
+    for (int i = 0; i < quarantine_count; i++) {
+        if (quarantine[i]) debug_evict(quarantine[i]);
+        quarantine[i] = NULL;
+    }
+    quarantine_next = 0;
+}
+
+/// @brief number of heap corruptions detected so far, each one is also
+/// printed to stderr
+size_t mem_debug_errors() { return debug_errors; }
+#endif
+
+/// @brief allocates a block charged to tag
+/// @param zero clear the bytes handed out
+void *tagged_alloc(int tag, size_t size, bool zero) {
+#ifdef MEM_DEBUG
+    // the tag word goes at the end of the back redzone
+    void *block = debug_alloc(size, align_size, zero, -1);
+#else
+    void *block =
+        heap_alloc(ALIGN(size) + sizeof(uint32_t), zero ? 0 : SIZE_MAX, -1);
+#endif
+    if (!block) return NULL;
+    header *block_header = user_header(block);
+    if (!tag_fits(tag, block_size(block_header))) {
+        heap_free(block_header + 1);
+        return NULL;
+    }
+    tag_set(block_header, tag);
+    tags[tag].allocations++;
+    return block;
+}
+
+/// @brief mem_resize for a tagged block, the result keeps the tag
+void *tagged_resize(void *block, size_t size, bool zero) {
+    header *block_header = user_header(block);
+    int tag = *tag_word(block_header);
+#ifdef MEM_DEBUG
+    size_t old_size = ((debug_meta *)(block - redzone_size))->size;
+    debug_left += ALIGN(old_size);
+    void *new_block = tagged_alloc(tag, size, false);
+    debug_left -= ALIGN(old_size);
+    if (!new_block) return NULL;
+    memcpy(new_block, block, (old_size < size) ? old_size : size);
+    if (zero && size > old_size) memset(new_block + old_size, 0, size - old_size);
+    debug_free(block);
+    return new_block;
+#else
+    size_t old_charge = block_size(block_header);
+    size_t new_charge = ALIGN(size) + sizeof(uint32_t);
+    if (new_charge > old_charge && !tag_fits(tag, new_charge - old_charge))
+        return NULL;
+    // past the old usable size has to read as zero, that includes the tag
+    if (zero) memset(tag_word(block_header), 0, sizeof(uint32_t));
+    tag_clear(block_header);
+    void *new_block = heap_resize(block, new_charge, zero);
+    tag_set(user_header(new_block ? new_block : block), tag);
+    return new_block;
+#endif
+}
+
+/// @brief mem_alloc, but the block's bytes are accounted to tag and the
+/// allocation fails rather than take the tag over its limit
+/// @param tag 0 to MEM_TAG_COUNT - 1
+/// @param size size in bytes
+/// @return NULL if out of memory or over the limit
+void *mem_alloc_tagged(int tag, size_t size) {
+    if (tag < 0 || tag >= MEM_TAG_COUNT) return NULL;
+    void *block;
+    int next = 0;
+    do {
+        heap_lock();
+        block = tagged_alloc(tag, size, false);
+        heap_unlock();
+    } while (pressure_retry(!block, size, &next));
+    return block;
+}
+
+/// @brief the tag a block was allocated with
+/// @return -1 for untagged blocks
+int mem_tag_of(void *block) {
+    if (!block) return -1;
+    header *block_header = user_header(block);
+    if (!(*block_header & block_tag_mask)) return -1;
+    return *tag_word(block_header);
+}
+
+/// @brief caps the bytes that tag may have allocated at once
+/// @param limit size in bytes, 0 for no limit
+void mem_tag_set_limit(int tag, size_t limit) {
+    if (tag < 0 || tag >= MEM_TAG_COUNT) return;
+    heap_lock();
+    tags[tag].limit = limit;
+    heap_unlock();
+}
+
+/// @brief copies the counters of every tag
+/// @param stats room for MEM_TAG_COUNT entries
+void mem_tag_snapshot(mem_tag_stats *stats) {
+    heap_lock();
+    memcpy(stats, tags, sizeof(tags));
+    heap_unlock();
 }
 
 /// @brief returns pointer to memory block, NULL if no chunk of proper size
@@ -61,56 +1534,285 @@ void mem_init(size_t size) {
 /// @param size size in bytes
 /// @return
 void *mem_alloc(size_t size) {
-    if(size > space_left) return NULL;
-    if(size == 0) return memory_ + sizeof(header);
-    size = ALIGN(size);
-    header *first_free_block = NULL;
-    header *walker = memory_;
-    size_t continius_memory = 0;
-    while (walker != memory_end) {
-        while (!block_isfree(walker)) {
-            walker = block_get_next(walker);
-            if (walker == memory_end) return NULL;
-        }
-        first_free_block = walker;
-        while (walker != memory_end && block_isfree(walker)) {
-            continius_memory += block_size(walker) + sizeof(header);
-            walker = block_get_next(walker);
-        }
-        if (continius_memory - sizeof(header) >= size && first_free_block) {
-            if (continius_memory - sizeof(header) < size + sizeof(header)) {
-                block_set_size(first_free_block,
-                               continius_memory - sizeof(header));
-                block_set_free(first_free_block, false);
-
-                space_left -= size;
-                return first_free_block + 1;
-            }
-            block_set_size(first_free_block, size);
-            block_set_free(first_free_block, false);
+    PERF_BEGIN("mem_alloc");
+    void *block;
+    int next = 0;
+    do {
+        heap_lock();
+#ifdef MEM_DEBUG
+        block = debug_alloc(size, align_size, false, -1);
+#else
+        block = heap_alloc(size, SIZE_MAX, -1);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!block, size, &next));
+    PERF_END();
+    return block;
+}
 
-            header *new_block = block_get_next(first_free_block);
-            block_set_size(new_block,
-                           continius_memory - size - 2 * sizeof(header));
-            block_set_free(new_block, true);
+/// @brief allocates n * size zeroed bytes, only clearing what isn't already
+/// known to be zero
+/// @param n number of elements
+/// @param size element size in bytes
+/// @return NULL if out of memory or n * size overflows
+void *mem_calloc(size_t n, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(n, size, &total)) return NULL;
+    PERF_BEGIN("mem_calloc");
+    void *block;
+    int next = 0;
+    do {
+        heap_lock();
+#ifdef MEM_DEBUG
+        block = debug_alloc(total, align_size, true, -1);
+#else
+        block = heap_alloc(total, 0, -1);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!block, total, &next));
+    PERF_END();
+    return block;
+}
 
-            space_left -= size;
-            return first_free_block + 1;
-        }
-        continius_memory = 0;
-        first_free_block = NULL;
-    }
-    return NULL;
+/// @brief like mem_alloc but the returned block starts on a multiple of
+/// alignment
+/// @param alignment power of two
+/// @param size size in bytes
+/// @return pointer to memory block, NULL if no chunk of proper size found
+void *mem_alloc_aligned(size_t alignment, size_t size) {
+    PERF_BEGIN("mem_alloc_aligned");
+    void *block;
+    int next = 0;
+    do {
+        heap_lock();
+#ifdef MEM_DEBUG
+        block = debug_alloc(size, alignment, false, -1);
+#else
+        block = heap_alloc_aligned(alignment, size, SIZE_MAX);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!block, size + alignment, &next));
+    PERF_END();
+    return block;
+}
+
+/// @brief mem_calloc, but the block starts on a multiple of alignment
+/// @param alignment power of two
+/// @param n number of elements
+/// @param size size of each element in bytes
+/// @return NULL if out of memory or n * size overflows
+void *mem_calloc_aligned(size_t alignment, size_t n, size_t size) {
+    size_t total;
+    if (__builtin_mul_overflow(n, size, &total)) return NULL;
+    void *block;
+    int next = 0;
+    do {
+        heap_lock();
+#ifdef MEM_DEBUG
+        block = debug_alloc(total, alignment, true, -1);
+#else
+        block = heap_alloc_aligned(alignment, total, 0);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!block, total + alignment, &next));
+    return block;
 }
 
 /// @brief Frees the memory block preventing memory leaks
 /// @param block block to free
 void mem_free(void *block) {
     if (!block) return;
-    if (!block_is_valid(block - sizeof(header))) return;
-    header *block_header = block - sizeof(header);
-    block_set_free(block_header, true);
-    space_left += block_size(block_header);
+    if (block >= arena_start && block < arena_end) return;
+    PERF_BEGIN("mem_free");
+    heap_lock();
+#ifdef MEM_DEBUG
+    debug_free(block);
+#else
+    heap_free(block);
+#endif
+    heap_unlock();
+    PERF_END();
+}
+
+/// @brief allocates count blocks of size bytes, carved out of as few free
+/// blocks as possible so neighbouring ones end up next to each other
+/// @param size size in bytes of each block
+/// @param count number of blocks
+/// @param out receives the blocks
+/// @return false if they don't all fit, nothing is allocated then
+bool mem_alloc_batch(size_t size, size_t count, void **out) {
+    PERF_BEGIN("mem_alloc_batch");
+    bool ok;
+    int next = 0;
+    do {
+        heap_lock();
+#ifdef MEM_DEBUG
+        size_t done = 0;
+        while (done < count &&
+               (out[done] = debug_alloc(size, align_size, false, -1)))
+            done++;
+        for (size_t i = 0; done < count && i < done; i++) debug_free(out[i]);
+        ok = done == count;
+#else
+        ok = heap_alloc_batch(size, count, out);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!ok, (ALIGN(size) + sizeof(header)) * count, &next));
+    PERF_END();
+    return ok;
+}
+
+/// @brief frees count blocks, merging the free runs they leave behind at once
+/// @param blocks blocks to free, reordered by address, NULL entries are
+/// skipped
+/// @param count number of blocks
+void mem_free_batch(void **blocks, size_t count) {
+    PERF_BEGIN("mem_free_batch");
+    heap_lock();
+#ifdef MEM_DEBUG
+    for (size_t i = 0; i < count; i++)
+        if (blocks[i] && !(blocks[i] >= arena_start && blocks[i] < arena_end))
+            debug_free(blocks[i]);
+#else
+    heap_free_batch(blocks, count);
+#endif
+    heap_unlock();
+    PERF_END();
+}
+
+/// @brief where a reference counted block keeps its count, the last word
+uint32_t *rc_word(void *block) {
+    return block + mem_usable_size(block) - sizeof(uint32_t);
+}
+
+/// @brief mem_alloc for a block shared by reference count, starting at one.
+/// mem_retain and mem_release may be called from any thread
+/// @param size size in bytes, the count lives right after it
+/// @return NULL if out of memory
+void *mem_alloc_rc(size_t size) {
+    void *block = mem_alloc(ALIGN(size) + sizeof(uint32_t));
+    if (block) *rc_word(block) = 1;
+    return block;
+}
+
+/// @brief takes another reference to a block from mem_alloc_rc
+/// @param block
+void mem_retain(void *block) {
+    __atomic_fetch_add(rc_word(block), 1, __ATOMIC_RELAXED);
+}
+
+/// @brief drops a reference to a block from mem_alloc_rc, freeing it with
+/// the last one
+/// @param block
+/// @return true if that was the last reference and the block is gone
+bool mem_release(void *block) {
+    if (__atomic_sub_fetch(rc_word(block), 1, __ATOMIC_ACQ_REL)) return false;
+    mem_free(block);
+    return true;
+}
+
+/// @brief number of references to a block from mem_alloc_rc
+uint32_t mem_refcount(void *block) {
+    return __atomic_load_n(rc_word(block), __ATOMIC_ACQUIRE);
+}
+
+/// @brief where a block on the deferred stack keeps the link to the next one
+uint32_t *deferred_link(void *block) {
+#ifdef MEM_DEBUG
+    return &((debug_meta *)(block - redzone_size))->deferred;
+#else
+    return block;
+#endif
+}
+
+/// @brief frees a chain of blocks popped off the deferred stack, taking the
+/// heap lock once per batch so other threads get a turn
+void deferred_free_chain(uint32_t link) {
+    while (link) {
+        size_t freed = 0;
+        heap_lock();
+        while (link && freed < reclaim_batch) {
+            void *block = mem_ptr(link);
+            link = *deferred_link(block);
+#ifdef MEM_DEBUG
+            debug_free(block);
+#else
+            heap_free(block);
+#endif
+            freed++;
+        }
+        heap_unlock();
+        __atomic_fetch_sub(&deferred_pending, freed, __ATOMIC_RELEASE);
+    }
+}
+
+void *reclaimer_main(void *arg) {
+    for (;;) {
+        sem_wait(&reclaimer_wake);
+        deferred_free_chain(__atomic_exchange_n(&deferred_head, 0, __ATOMIC_ACQUIRE));
+        if (__atomic_load_n(&reclaimer_stop, __ATOMIC_ACQUIRE)) return NULL;
+    }
+}
+
+/// @brief starts the reclaimer thread if it isn't running yet
+/// @return false if it couldn't be started
+bool reclaimer_start() {
+    static pthread_mutex_t start_lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&start_lock);
+    if (!reclaimer_running) {
+        reclaimer_stop = false;
+        sem_init(&reclaimer_wake, 0, 0);
+        if (pthread_create(&reclaimer, NULL, reclaimer_main, NULL) == 0)
+            __atomic_store_n(&reclaimer_running, true, __ATOMIC_RELEASE);
+        else
+            sem_destroy(&reclaimer_wake);
+    }
+    pthread_mutex_unlock(&start_lock);
+    return reclaimer_running;
+}
+
+/// @brief queues block to be freed by a background thread, returning at once.
+/// Never waits for the heap lock, so freeing stays cheap while other threads
+/// allocate. Pools that can grow past 16 GiB free the block right away
+/// @param block block to free
+void mem_free_deferred(void *block) {
+    if (!block || !memory_) return;
+    if (block >= arena_start && block < arena_end) return;
+    if ((uint64_t)(memory_limit - memory_) > deferred_reach ||
+        (!__atomic_load_n(&reclaimer_running, __ATOMIC_ACQUIRE) &&
+         !reclaimer_start())) {
+        mem_free(block);
+        return;
+    }
+    __atomic_fetch_add(&deferred_pending, 1, __ATOMIC_RELAXED);
+    uint32_t link = mem_offset(block);
+    uint32_t head = __atomic_load_n(&deferred_head, __ATOMIC_RELAXED);
+    do {
+        *deferred_link(block) = head;
+    } while (!__atomic_compare_exchange_n(&deferred_head, &head, link, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    // the reclaimer empties the whole stack each time it wakes
+    if (head == 0) sem_post(&reclaimer_wake);
+}
+
+/// @brief returns once every block passed to mem_free_deferred so far has been
+/// freed, helping with whatever is still queued
+void mem_flush_deferred() {
+    if (!__atomic_load_n(&reclaimer_running, __ATOMIC_ACQUIRE)) return;
+    deferred_free_chain(__atomic_exchange_n(&deferred_head, 0, __ATOMIC_ACQUIRE));
+    // blocks the reclaimer has already taken
+    while (__atomic_load_n(&deferred_pending, __ATOMIC_ACQUIRE)) sched_yield();
+}
+
+/// @brief frees what is queued and stops the reclaimer thread
+void reclaimer_shutdown() {
+    if (!reclaimer_running) return;
+    mem_flush_deferred();
+    __atomic_store_n(&reclaimer_stop, true, __ATOMIC_RELEASE);
+    sem_post(&reclaimer_wake);
+    pthread_join(reclaimer, NULL);
+    sem_destroy(&reclaimer_wake);
+    __atomic_store_n(&reclaimer_running, false, __ATOMIC_RELEASE);
 }
 
 /// @brief changes the size of the block, if possible without moving it, returns
@@ -119,23 +1821,464 @@ void mem_free(void *block) {
 /// @param size size in bytes
 /// @return pointer to resized block, NULL if failed
 void *mem_resize(void *block, size_t size) {
-    if (block == NULL) return mem_alloc(size);
-    if (!block_is_valid(block - sizeof(header))) return NULL;
-    if (size == 0) {
-        mem_free(block);
-        return NULL;
+    PERF_BEGIN("mem_resize");
+    void *resized;
+    int next = 0;
+    do {
+        heap_lock();
+        if (block && size && mem_tag_of(block) >= 0)
+            resized = tagged_resize(block, size, false);
+        else
+#ifdef MEM_DEBUG
+            resized = debug_resize(block, size, false);
+#else
+            resized = heap_resize(block, size, false);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!resized && size, size, &next));
+    PERF_END();
+    return resized;
+}
+
+/// @brief mem_resize, but anything past the old usable size reads as zero
+/// @param block block to resize
+/// @param size size in bytes
+/// @return pointer to resized block, NULL if failed
+void *mem_resize_zeroed(void *block, size_t size) {
+    void *resized;
+    int next = 0;
+    do {
+        heap_lock();
+        if (block && size && mem_tag_of(block) >= 0)
+            resized = tagged_resize(block, size, true);
+        else
+#ifdef MEM_DEBUG
+            resized = debug_resize(block, size, true);
+#else
+            resized = heap_resize(block, size, true);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!resized && size, size, &next));
+    return resized;
+}
+
+/// @brief returns how many bytes the block can hold, which may be more than
+/// was asked for
+/// @param block block from mem_alloc
+/// @return size in bytes
+size_t mem_usable_size(void *block) {
+    if (!block) return 0;
+#ifdef MEM_DEBUG
+    return ((debug_meta *)(block - redzone_size))->size;
+#else
+    header *block_header = block - sizeof(header);
+    if (*block_header & block_tag_mask)
+        return block_size(block_header) - sizeof(uint32_t);
+    return block_size(block_header);
+#endif
+}
+
+/// @brief summarises the free space of the pool, adjacent free blocks count
+/// as one since they merge as soon as they are needed
+/// @param stats
+void mem_get_stats(mem_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    heap_lock();
+    header *walker = memory_;
+    size_t run = 0;
+    while ((void *)walker < memory_end) {
+        if (block_isfree(walker)) {
+            run += block_size(walker) + (run ? sizeof(header) : 0);
+            stats->free_bytes += block_size(walker);
+        } else if (block_iscached(walker)) {
+            stats->cached_bytes += block_size(walker);
+            run = 0;
+        } else {
+            if (block_size(walker)) stats->used_blocks++;  // not a partition end
+            run = 0;
+        }
+        header *next = block_get_next(walker);
+        if (run && ((void *)next == memory_end || !block_isfree(next))) {
+            stats->free_runs++;
+            if (run > stats->largest_free) stats->largest_free = run;
+        }
+        walker = next;
     }
-    header *header = block - sizeof(*header);
-    block_set_free(header, true);
-    void *new_block = mem_alloc(size);
-    if (!new_block) {
-        block_set_free(header, false);
-        return NULL;
+#ifdef MEM_DEBUG
+    // quarantined blocks are freed as far as the caller is concerned
+    for (int i = 0; i < quarantine_count; i++) {
+        if (!quarantine[i]) continue;
+        stats->used_blocks--;
+        stats->cached_bytes += block_size(user_header(quarantine[i]));
     }
-    size_t minsize = (block_size(header) < size) ? block_size(header) : size;
-    memcpy(new_block, ((void *)header) + sizeof(*header), minsize);
-    return new_block;
+#endif
+    for (int i = 0; i < zero_range_used; i++) {
+        void *end = zero_ranges[i].end;
+        if (end > memory_end) end = memory_end;
+        if (end > zero_ranges[i].start) stats->zero_bytes += end - zero_ranges[i].start;
+    }
+    stats->hugetlb = pool_hugetlb;
+    heap_unlock();
+}
+
+/// @brief like mem_alloc but only from the part of the pool placed on node
+/// @param size size in bytes
+/// @param node NUMA node, see mem_numa_nodes
+/// @return NULL if that node has no chunk of proper size
+void *mem_alloc_node(size_t size, int node) {
+    if (node < 0 || node >= partition_count) return NULL;
+    void *block;
+    int next = 0;
+    do {
+        heap_lock();
+#ifdef MEM_DEBUG
+        block = debug_alloc(size, align_size, false, node);
+#else
+        block = heap_alloc(size, SIZE_MAX, node);
+#endif
+        heap_unlock();
+    } while (pressure_retry(!block, size, &next));
+    return block;
+}
+
+/// @brief number of nodes the pool is split across, 1 unless
+/// mem_options.numa was set
+int mem_numa_nodes() { return partition_count; }
+
+/// @brief the NUMA node the pool placed a block on
+/// @param block
+/// @return -1 if the block isn't from the pool
+int mem_node_of(void *block) {
+    if (!mem_owns(block)) return -1;
+    return partition_of(block) - partitions;
+}
+
+/// @brief checks if a pointer lies within the pool
+/// @param block
+/// @return
+bool mem_owns(void *block) {
+    return memory_ && block > memory_ && block < memory_end;
+}
+
+/// @brief encodes a pointer into the pool as 32 bits that stay valid wherever
+/// the pool is mapped, counted in 4 byte units so they reach 16 GiB
+/// @param block 4 byte aligned pointer into the pool, or NULL
+/// @return 0 for NULL
+uint32_t mem_offset(void *block) {
+    if (!block) return 0;
+    return (block - memory_) / align_size;
+}
+
+/// @brief turns a mem_offset back into a pointer
+/// @param offset from mem_offset
+/// @return NULL for 0
+void *mem_ptr(uint32_t offset) {
+    if (!offset) return NULL;
+    return memory_ + (size_t)offset * align_size;
+}
+
+/// @brief remembers one block for whoever attaches to the pool next, such as
+/// the head of a list kept in a shared or restored pool
+/// @param block block from the pool, NULL to clear
+void mem_set_root(void *block) {
+    if (shared)
+        __atomic_store_n(&shared->root, mem_offset(block), __ATOMIC_RELEASE);
+    else
+        root = mem_offset(block);
+}
+
+/// @brief the block given to mem_set_root
+/// @return NULL if none
+void *mem_get_root() {
+    if (shared) return mem_ptr(__atomic_load_n(&shared->root, __ATOMIC_ACQUIRE));
+    return mem_ptr(root);
+}
+
+/// @brief registers a callback that frees memory when the heap runs short,
+/// e.g. by shrinking a cache. It is called with the number of bytes wanted
+/// and returns roughly how many it freed, 0 if it had nothing to give
+/// @param fn
+/// @param ctx passed to fn
+/// @param priority callbacks with lower priorities run first
+/// @return false if there are already 16 callbacks, mem_deinit drops them all
+bool mem_reclaim_register(mem_reclaim_fn fn, void *ctx, int priority) {
+    pthread_mutex_lock(&pressure_mutex);
+    bool room = pressure_count < pressure_max;
+    if (room) {
+        int i = pressure_count++;
+        for (; i > 0 && pressure_callbacks[i - 1].priority > priority; i--)
+            pressure_callbacks[i] = pressure_callbacks[i - 1];
+        pressure_callbacks[i] = (pressure_callback){fn, ctx, priority};
+    }
+    pthread_mutex_unlock(&pressure_mutex);
+    return room;
+}
+
+/// @brief removes a callback registered with the same fn and ctx
+void mem_reclaim_unregister(mem_reclaim_fn fn, void *ctx) {
+    pthread_mutex_lock(&pressure_mutex);
+    for (int i = 0; i < pressure_count; i++) {
+        if (pressure_callbacks[i].fn != fn || pressure_callbacks[i].ctx != ctx)
+            continue;
+        pressure_count--;
+        memmove(&pressure_callbacks[i], &pressure_callbacks[i + 1],
+                (pressure_count - i) * sizeof(pressure_callback));
+        break;
+    }
+    pthread_mutex_unlock(&pressure_mutex);
+}
+
+/// @brief sets the soft limit, the reclaim callbacks run whenever an
+/// allocation leaves fewer than bytes free rather than only once one fails
+/// @param bytes 0 to only reclaim on failure
+void mem_set_watermark(size_t bytes) { pressure_watermark = bytes; }
+
+/// @brief the size classes learned so far, see mem_options.adaptive
+/// @param sizes receives up to max class sizes in bytes, most requested first
+/// @param max room in sizes
+/// @return number of classes
+int mem_adapt_classes(size_t *sizes, int max) {
+    heap_lock();
+    int count = adapt_class_count < max ? adapt_class_count : max;
+    for (int i = 0; i < count; i++) sizes[i] = adapt_classes[i] - adapt_overhead;
+    heap_unlock();
+    return count;
+}
+
+/// @brief writes the request size histogram to a text file, one size and
+/// count per line, for mem_adapt_load to start another pool from
+/// @param path file to create or overwrite
+/// @return false if it couldn't be written
+bool mem_adapt_save(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) return false;
+    heap_lock();
+    for (int bin = 1; bin < adapt_bins; bin++)
+        if (adapt_histogram[bin] && (size_t)bin * align_size > adapt_overhead)
+            fprintf(file, "%zu %llu\n", (size_t)bin * align_size - adapt_overhead,
+                    (unsigned long long)adapt_histogram[bin]);
+    heap_unlock();
+    return fclose(file) == 0;
+}
+
+/// @brief replaces the histogram with one saved by mem_adapt_save and derives
+/// the classes from it right away, turning on adaptive mode. The pool must be
+/// initialized
+/// @param path file to read
+/// @return false if it can't be read or holds anything but size count lines
+bool mem_adapt_load(const char *path) {
+    if (!memory_ || shared) return false;
+    FILE *file = fopen(path, "r");
+    if (!file) return false;
+    uint64_t histogram[adapt_bins] = {0};
+    size_t size;
+    unsigned long long count;
+    int read;
+    while ((read = fscanf(file, "%zu %llu", &size, &count)) == 2) {
+        if (size % align_size || size > adapt_max_size) break;
+        if (size + adapt_overhead <= adapt_max_size)
+            histogram[(size + adapt_overhead) / align_size] = count;
+    }
+    bool valid = read == EOF && !ferror(file);
+    fclose(file);
+    if (!valid) return false;
+    heap_lock();
+    memcpy(adapt_histogram, histogram, sizeof(histogram));
+    adapt_samples = 0;
+    adapt_enabled = true;
+    adapt_derive();
+    heap_unlock();
+    return true;
+}
+
+/// @brief reserves size bytes of the pool for mem_arena_alloc, there is only
+/// one arena at a time
+/// @param size size in bytes
+/// @return false if the pool has no room for it
+bool mem_arena_init(size_t size) {
+    if (arena_start || shared) return false;
+    arena_start = mem_alloc_aligned(arena_align, size);
+    if (!arena_start) return false;
+    arena_bump = arena_start;
+    arena_end = arena_start + mem_usable_size(arena_start);
+    return true;
+}
+
+/// @brief bump allocates from the arena, the block carries no header and can
+/// only be given back through mem_arena_reset or mem_arena_release
+/// @param size size in bytes
+/// @return NULL if the arena is used up
+void *mem_arena_alloc(size_t size) {
+    size = (size + arena_align - 1) & ~(size_t)(arena_align - 1);
+    if (size > (size_t)(arena_end - arena_bump)) return NULL;
+    void *block = arena_bump;
+    arena_bump += size;
+    return block;
+}
+
+/// @brief frees everything allocated from the arena at once, the arena itself
+/// stays reserved
+void mem_arena_reset() { arena_bump = arena_start; }
+
+/// @brief frees everything allocated from the arena and returns the arena to
+/// the pool
+void mem_arena_release() {
+    if (!arena_start) return;
+    void *block = arena_start;
+    arena_start = arena_bump = arena_end = NULL;
+    mem_free(block);
+}
+
+/// @brief writes the pool and everything needed to pick it up again to path,
+/// the arena comes back as used blocks
+/// @param path file to create or overwrite
+/// @return false on failure or for shared pools
+bool mem_snapshot(const char *path) {
+    if (!memory_ || shared) return false;
+    mem_flush_deferred();
+    heap_lock();
+    // the quick lists and the quarantine aren't part of the snapshot
+    quick_drain();
+#ifdef MEM_DEBUG
+    debug_drain();
+#endif
+    size_t page = sysconf(_SC_PAGESIZE);
+    // on the stack, the pool may be what backs malloc
+    snapshot_header snapshot = {0};
+    snapshot_header *snap = &snapshot;
+    snap->magic = snapshot_magic;
+    snap->partition_count = partition_count;
+    snap->data_offset = (sizeof(snapshot_header) + page - 1) & ~(page - 1);
+    snap->size = memory_end - memory_;
+    snap->base = (uintptr_t)memory_;
+    snap->space_left = space_left;
+    snap->fit_limit = fit_limit;
+    snap->policy = policy;
+    snap->numa = numa_enabled;
+    snap->root = root;
+    for (int i = 0; i < partition_count; i++) {
+        partition *part = &partitions[i];
+        snapshot_partition *saved = &snap->partitions[i];
+        saved->start = (void *)part->start - memory_;
+        saved->end = part->end - memory_;
+        saved->rover = (void *)part->rover - memory_;
+        memcpy(saved->bins, part->bins, sizeof(saved->bins));
+        saved->coalesce_pending = part->coalesce_pending;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    bool written = fd >= 0 &&
+                   pwrite(fd, snap, sizeof(*snap), 0) == sizeof(*snap);
+    for (size_t done = 0; written && done < snap->size;) {
+        ssize_t count = pwrite(fd, memory_ + done, snap->size - done,
+                               snap->data_offset + done);
+        written = count > 0;
+        done += count;
+    }
+    if (fd >= 0) close(fd);
+    heap_unlock();
+    return written;
+}
+
+/// @brief replaces the pool with the one saved to path by mem_snapshot,
+/// mapping it from the file so only the pages that are used get read.
+/// Pointers stored inside the pool go through mem_relocate
+/// @param path file written by mem_snapshot
+/// @return false if the file is unusable, the current pool is kept then
+bool mem_restore(const char *path) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    snapshot_header snapshot;
+    snapshot_header *snap = &snapshot;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    bool valid = fd >= 0 && fstat(fd, &st) == 0 &&
+                 pread(fd, snap, sizeof(*snap), 0) == sizeof(*snap) &&
+                 snap->magic == snapshot_magic && snap->data_offset % page == 0 &&
+                 snap->partition_count >= 1 && snap->partition_count <= node_max &&
+                 (uint64_t)st.st_size >= snap->data_offset + snap->size;
+    if (!valid) {
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    mem_deinit();
+    // the old address keeps stored pointers valid, anywhere else works too
+    memory_ = mmap((void *)snap->base, snap->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_FIXED_NOREPLACE, fd, snap->data_offset);
+    if (memory_ == MAP_FAILED)
+        memory_ = mmap(NULL, snap->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                       snap->data_offset);
+    close(fd);
+    if (memory_ == MAP_FAILED) {
+        memory_ = NULL;
+        return false;
+    }
+    memory_end = memory_limit = memory_ + snap->size;
+    snapshot_base = snap->base;
+    space_left = snap->space_left;
+#ifdef MEM_DEBUG
+    // the snapshot doesn't say what the blocks in it were charged
+    debug_left = space_left;
+#endif
+    fit_limit = snap->fit_limit;
+    policy = snap->policy;
+    numa_enabled = snap->numa;
+    root = snap->root;
+    page_size = page;
+    pool_hugetlb = false;
+    partition_count = snap->partition_count;
+    for (int i = 0; i < partition_count; i++) {
+        partition *part = &partitions[i];
+        snapshot_partition *saved = &snap->partitions[i];
+        part->start = memory_ + saved->start;
+        part->end = memory_ + saved->end;
+        part->rover = memory_ + saved->rover;
+        memcpy(part->bins, saved->bins, sizeof(part->bins));
+        part->coalesce_pending = saved->coalesce_pending;
+    }
+    return true;
+}
+
+/// @brief translates a pointer into the pool a snapshot was taken of into
+/// the restored pool
+/// @param pointer pointer read from the restored pool
+/// @return NULL for NULL
+void *mem_relocate(void *pointer) {
+    if (!pointer || !snapshot_base) return pointer;
+    return memory_ + ((uintptr_t)pointer - snapshot_base);
 }
 
 /// @brief returns the memory used by the memory manager
-void mem_deinit() { free(memory_); }
\ No newline at end of file
+void mem_deinit() {
+    reclaimer_shutdown();
+#ifdef MEM_DEBUG
+    if (memory_) {
+        heap_lock();
+        debug_drain();
+        heap_unlock();
+    }
+#endif
+    if (shared) {
+        // the region stays for the other processes, shm_unlink removes it
+        munmap(shared, memory_limit - (void *)shared);
+        close(shared_fd);
+        shared = NULL;
+        shared_fd = -1;
+    } else if (memory_) {
+        munmap(memory_, memory_limit - memory_);
+    }
+    memory_ = memory_end = memory_limit = NULL;
+    root = 0;
+    snapshot_base = 0;
+    arena_start = arena_bump = arena_end = NULL;
+    zero_range_used = 0;
+    partition_count = 0;
+    space_left = 0;
+    memset(tags, 0, sizeof(tags));
+    pressure_count = 0;
+    pressure_watermark = 0;
+    adapt_enabled = false;
+    memset(adapt_histogram, 0, sizeof(adapt_histogram));
+    adapt_samples = 0;
+    adapt_class_count = 0;
+    memset(quick_heads, 0, sizeof(quick_heads));
+    memset(quick_lengths, 0, sizeof(quick_lengths));
+}
@@ -6,14 +6,161 @@
 #include <string.h>
 #include <stdint.h>
 
+// how mem_alloc picks among the free blocks that fit
+typedef enum mem_policy {
+    MEM_FIRST_FIT,  // lowest address, the default
+    MEM_NEXT_FIT,   // first fit from where the previous search ended
+    MEM_BEST_FIT,   // smallest block, through an index of blocks by size
+    MEM_GOOD_FIT,   // smallest of the first fit_limit blocks in the index
+} mem_policy;
+
+typedef struct mem_options {
+    // address space to reserve so mem_grow can extend the pool in place, 0
+    // for a fixed size pool
+    size_t max_size;
+    mem_policy policy;
+    // MEM_GOOD_FIT only, 0 for the default of 8
+    size_t fit_limit;
+    // split the pool into one part per NUMA node, allocating from the calling
+    // thread's node first
+    bool numa;
+    // number of nodes to split for, 0 to ask the kernel
+    int numa_nodes;
+    // back the pool with 2 MiB pages, reserved hugetlb pages if there are
+    // enough, transparent huge pages otherwise
+    bool huge_pages;
+    // fault in the whole pool during mem_init instead of on first touch
+    bool prefault;
+    // keep the pool and the heap's state in shared memory so other processes
+    // can allocate in it too, nothing else but the policy applies
+    bool shared;
+    // shm_open name, the region is created with size bytes if it doesn't
+    // exist and attached to otherwise. NULL for an unnamed memfd region that
+    // is shared with forked children
+    const char* shared_name;
+    // learn size classes from the sizes requested and keep freed blocks of
+    // those sizes aside for the next request, see mem_adapt_save
+    bool adaptive;
+} mem_options;
+
+typedef struct mem_stats {
+    size_t free_bytes;
+    size_t free_runs;     // stretches of adjacent free blocks
+    size_t largest_free;  // biggest block mem_alloc could hand out
+    size_t used_blocks;
+    size_t zero_bytes;    // known to be zero, mem_calloc skips clearing these
+    size_t cached_bytes;  // freed but kept on the quick lists, see adaptive
+    bool hugetlb;         // the pool got MAP_HUGETLB pages
+} mem_stats;
+
+// frees what it can of wanted bytes, see mem_reclaim_register
+typedef size_t (*mem_reclaim_fn)(size_t wanted, void* ctx);
+
+// tags mem_alloc_tagged can charge allocations to
+#define MEM_TAG_COUNT 64
+
+typedef struct mem_tag_stats {
+    size_t live;   // bytes allocated with the tag right now
+    size_t peak;   // highest live has been
+    size_t limit;  // 0 for none
+    size_t allocations;
+    size_t failures;  // allocations refused for going over limit
+} mem_tag_stats;
+
 void mem_init(size_t size);
 
+void mem_init_opts(size_t size, const mem_options* opts);
+
+bool mem_grow(size_t size);
+
 void* mem_alloc(size_t size);
 
+void* mem_alloc_aligned(size_t alignment, size_t size);
+
+void* mem_calloc(size_t n, size_t size);
+
+void* mem_calloc_aligned(size_t alignment, size_t n, size_t size);
+
+void* mem_alloc_node(size_t size, int node);
+
+void* mem_alloc_tagged(int tag, size_t size);
+
+int mem_tag_of(void* block);
+
+void mem_tag_set_limit(int tag, size_t limit);
+
+void mem_tag_snapshot(mem_tag_stats* stats);
+
 void mem_free(void* block);
 
+void* mem_alloc_rc(size_t size);
+
+void mem_retain(void* block);
+
+bool mem_release(void* block);
+
+uint32_t mem_refcount(void* block);
+
+bool mem_alloc_batch(size_t size, size_t count, void** out);
+
+void mem_free_batch(void** blocks, size_t count);
+
+void mem_free_deferred(void* block);
+
+void mem_flush_deferred();
+
 void* mem_resize(void* block, size_t size);
 
+void* mem_resize_zeroed(void* block, size_t size);
+
+size_t mem_usable_size(void* block);
+
+void mem_get_stats(mem_stats* stats);
+
+int mem_numa_nodes();
+
+int mem_node_of(void* block);
+
+bool mem_owns(void* block);
+
+uint32_t mem_offset(void* block);
+
+void* mem_ptr(uint32_t offset);
+
+void mem_set_root(void* block);
+
+void* mem_get_root();
+
+bool mem_snapshot(const char* path);
+
+bool mem_restore(const char* path);
+
+void* mem_relocate(void* pointer);
+
+bool mem_reclaim_register(mem_reclaim_fn fn, void* ctx, int priority);
+
+void mem_reclaim_unregister(mem_reclaim_fn fn, void* ctx);
+
+void mem_set_watermark(size_t bytes);
+
+int mem_adapt_classes(size_t* sizes, int max);
+
+bool mem_adapt_save(const char* path);
+
+bool mem_adapt_load(const char* path);
+
+bool mem_arena_init(size_t size);
+
+void* mem_arena_alloc(size_t size);
+
+void mem_arena_reset();
+
+void mem_arena_release();
+
 void mem_deinit();
 
+#ifdef MEM_DEBUG
+size_t mem_debug_errors();
+#endif
+
 #endif
\ No newline at end of file
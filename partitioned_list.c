@@ -0,0 +1,283 @@
+#include "partitioned_list.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// nodes per segment if plist_init is given 0
+#define PLIST_SEGMENT_SIZE 4096
+
+typedef void (*plist_job)(PSegment* segment, int index, void* ctx);
+
+// Workers sleep until generation changes, then take segments off next until
+// there are none left. The thread that started the job works along
+typedef struct plist_pool {
+    pthread_t* threads;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned generation;
+    int running;
+    bool stop;
+    PList* list;
+    plist_job job;
+    void* ctx;
+    int next;
+} plist_pool;
+
+/// @brief runs the current job on segments until every one is taken
+static void plist_run_segments(plist_pool* pool) {
+    PList* list = pool->list;
+    int index;
+    while ((index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) <
+           list->segment_count)
+        pool->job(&list->segments[index], index, pool->ctx);
+}
+
+static void* plist_worker(void* arg) {
+    plist_pool* pool = arg;
+    unsigned seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen)
+            pthread_cond_wait(&pool->start, &pool->lock);
+        if (pool->stop) break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        plist_run_segments(pool);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/// @brief runs job on every segment and returns once all are done
+static void plist_parallel(PList* list, plist_job job, void* ctx) {
+    plist_pool* pool = list->pool;
+    pool->list = list;
+    pool->job = job;
+    pool->ctx = ctx;
+    pool->next = 0;
+    if (pool->count == 0 || list->segment_count < 2) {
+        plist_run_segments(pool);
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->running = pool->count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    plist_run_segments(pool);
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running) pthread_cond_wait(&pool->done, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/// @brief Initializes the list and starts its threads
+/// @param list
+/// @param size size in bytes
+/// @param segment_size nodes per segment, 0 for the default
+/// @param threads threads to scan with, 0 for one per online CPU
+void plist_init(PList* list, size_t size, size_t segment_size, int threads) {
+    if (segment_size == 0) segment_size = PLIST_SEGMENT_SIZE;
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) threads = 1;
+    size_t capacity = size / sizeof(Node) / segment_size + 1;
+    size_t bookkeeping = capacity * sizeof(PSegment) + sizeof(plist_pool) +
+                         threads * sizeof(pthread_t) + 64;
+    mem_init(size + (4 * size) / sizeof(Node) + bookkeeping);
+    list->segments = mem_calloc(capacity, sizeof(PSegment));
+    list->segment_capacity = list->segments ? capacity : 0;
+    list->segment_count = 0;
+    list->segment_size = segment_size;
+
+    plist_pool* pool = mem_calloc(1, sizeof(plist_pool));
+    list->pool = pool;
+    if (!pool) return;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->threads = mem_alloc((threads - 1) * sizeof(pthread_t));
+    for (int i = 0; pool->threads && i < threads - 1; i++) {
+        if (pthread_create(&pool->threads[i], NULL, plist_worker, pool) != 0)
+            break;
+        pool->count++;
+    }
+}
+
+/// @brief inserts last in the list, starting a new segment when the last one
+/// is full
+/// @param list
+/// @param data data for the new node
+void plist_insert(PList* list, uint16_t data) {
+    PSegment* last = list->segment_count
+                         ? &list->segments[list->segment_count - 1]
+                         : NULL;
+    if (!last || last->length >= list->segment_size) {
+        if (list->segment_count == list->segment_capacity) {
+            int capacity = list->segment_capacity ? list->segment_capacity * 2 : 1;
+            PSegment* segments =
+                mem_resize(list->segments, capacity * sizeof(PSegment));
+            if (!segments) return;
+            list->segments = segments;
+            list->segment_capacity = capacity;
+        }
+        last = &list->segments[list->segment_count++];
+        memset(last, 0, sizeof(*last));
+    }
+    Node* new_node = mem_alloc(sizeof(Node));
+    if (!new_node) return;
+    new_node->data = data;
+    new_node->next = NULL;
+    if (last->tail)
+        last->tail->next = new_node;
+    else
+        last->head = new_node;
+    last->tail = new_node;
+    last->length++;
+}
+
+typedef struct plist_search_ctx {
+    uint16_t data;
+    int best;  // lowest segment with a match so far
+} plist_search_ctx;
+
+static void plist_search_segment(PSegment* segment, int index, void* arg) {
+    plist_search_ctx* ctx = arg;
+    segment->found = NULL;
+    // an earlier segment already has the answer
+    if (index > __atomic_load_n(&ctx->best, __ATOMIC_RELAXED)) return;
+    for (Node* walker = segment->head; walker; walker = walker->next) {
+        if (walker->data != ctx->data) continue;
+        segment->found = walker;
+        int best = __atomic_load_n(&ctx->best, __ATOMIC_RELAXED);
+        while (index < best &&
+               !__atomic_compare_exchange_n(&ctx->best, &best, index, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            ;
+        return;
+    }
+}
+
+/// @brief return the first node with data, in list order
+/// @param list
+/// @param data value to search for
+/// @return Node* or NULL if node not found
+Node* plist_search(PList* list, uint16_t data) {
+    plist_search_ctx ctx = {.data = data, .best = list->segment_count};
+    plist_parallel(list, plist_search_segment, &ctx);
+    if (ctx.best == list->segment_count) return NULL;
+    return list->segments[ctx.best].found;
+}
+
+/// @brief returns the number of nodes
+/// @param list
+size_t plist_count_nodes(PList* list) {
+    size_t count = 0;
+    for (int i = 0; i < list->segment_count; i++)
+        count += list->segments[i].length;
+    return count;
+}
+
+static void plist_count_segment(PSegment* segment, int index, void* ctx) {
+    uint16_t data = *(uint16_t*)ctx;
+    size_t count = 0;
+    for (Node* walker = segment->head; walker; walker = walker->next)
+        count += walker->data == data;
+    segment->result = count;
+}
+
+/// @brief returns the number of nodes holding data
+/// @param list
+/// @param data value to count
+size_t plist_count_value(PList* list, uint16_t data) {
+    plist_parallel(list, plist_count_segment, &data);
+    size_t count = 0;
+    for (int i = 0; i < list->segment_count; i++)
+        count += list->segments[i].result;
+    return count;
+}
+
+typedef struct plist_map_ctx {
+    uint16_t (*map)(uint16_t data, void* ctx);
+    void* ctx;
+} plist_map_ctx;
+
+static void plist_map_segment(PSegment* segment, int index, void* arg) {
+    plist_map_ctx* ctx = arg;
+    for (Node* walker = segment->head; walker; walker = walker->next)
+        walker->data = ctx->map(walker->data, ctx->ctx);
+}
+
+/// @brief replaces every value with map(value, ctx), map is called from
+/// several threads at once
+/// @param list
+/// @param map
+/// @param ctx passed through to map
+void plist_map(PList* list, uint16_t (*map)(uint16_t data, void* ctx), void* ctx) {
+    plist_map_ctx map_ctx = {map, ctx};
+    plist_parallel(list, plist_map_segment, &map_ctx);
+}
+
+typedef struct plist_filter_ctx {
+    bool (*keep)(uint16_t data, void* ctx);
+    void* ctx;
+} plist_filter_ctx;
+
+static void plist_filter_segment(PSegment* segment, int index, void* arg) {
+    plist_filter_ctx* ctx = arg;
+    Node** link = &segment->head;
+    Node* tail = NULL;
+    segment->result = 0;
+    while (*link) {
+        Node* node = *link;
+        if (ctx->keep(node->data, ctx->ctx)) {
+            tail = node;
+            link = &node->next;
+            continue;
+        }
+        // the memory manager takes its own lock, so workers free as they go
+        *link = node->next;
+        mem_free(node);
+        segment->result++;
+    }
+    segment->tail = tail;
+    segment->length -= segment->result;
+}
+
+/// @brief deletes every node for which keep returns false, keep is called
+/// from several threads at once
+/// @param list
+/// @param keep
+/// @param ctx passed through to keep
+/// @return number of nodes deleted
+size_t plist_filter(PList* list, bool (*keep)(uint16_t data, void* ctx),
+                    void* ctx) {
+    plist_filter_ctx filter_ctx = {keep, ctx};
+    plist_parallel(list, plist_filter_segment, &filter_ctx);
+    size_t removed = 0;
+    for (int i = 0; i < list->segment_count; i++)
+        removed += list->segments[i].result;
+    return removed;
+}
+
+/// @brief stops the threads and frees all used memory
+/// @param list
+void plist_cleanup(PList* list) {
+    plist_pool* pool = list->pool;
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stop = true;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+        for (int i = 0; i < pool->count; i++) pthread_join(pool->threads[i], NULL);
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->start);
+        pthread_cond_destroy(&pool->done);
+    }
+    list->segments = NULL;
+    list->segment_count = list->segment_capacity = 0;
+    list->pool = NULL;
+    mem_deinit();
+}
@@ -0,0 +1,52 @@
+#ifndef PARTITIONED_LIST_H
+#define PARTITIONED_LIST_H
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "common_defs.h"
+#include "linked_list.h"
+#include "memory_manager.h"
+
+// One stretch of a partitioned list, an ordinary chain of Nodes
+typedef struct PSegment {
+    Node* head;
+    Node* tail;
+    size_t length;
+    // what the last parallel operation found in this segment
+    Node* found;
+    size_t result;
+} PSegment;
+
+struct plist_pool;
+
+// A list cut into segments of at most segment_size nodes, the list's order is
+// segment 0 front to back, then segment 1 and so on. Scans give every
+// segment to one of the pool's threads and combine the results in segment
+// order, so they come out the same whatever the thread count. Only the scans
+// run in parallel, the list itself must not be used from several threads
+typedef struct PList {
+    PSegment* segments;
+    int segment_count;
+    int segment_capacity;
+    size_t segment_size;
+    struct plist_pool* pool;
+} PList;
+
+void plist_init(PList* list, size_t size, size_t segment_size, int threads);
+
+void plist_insert(PList* list, uint16_t data);
+
+Node* plist_search(PList* list, uint16_t data);
+
+size_t plist_count_nodes(PList* list);
+
+size_t plist_count_value(PList* list, uint16_t data);
+
+void plist_map(PList* list, uint16_t (*map)(uint16_t data, void* ctx), void* ctx);
+
+size_t plist_filter(PList* list, bool (*keep)(uint16_t data, void* ctx),
+                    void* ctx);
+
+void plist_cleanup(PList* list);
+
+#endif
@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include "perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define PERF_REGION_MAX 64
+
+#define PERF_CACHE_MISS(cache)                            \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) |       \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char* name;
+} perf_events[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_LL), "LLC misses"},
+    {PERF_TYPE_HW_CACHE, PERF_CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB),
+     "dTLB misses"},
+};
+
+// a thread's counters and what it measured, kept after the thread exits so
+// its numbers still show up in the report
+typedef struct perf_thread {
+    struct perf_thread* next;
+    // group leader, every counter is read at once through it, -1 if not a
+    // single counter could be opened
+    int group;
+    int fds[PERF_COUNTER_COUNT];
+    // where each counter sits in a group read, -1 if it couldn't be opened
+    int slots[PERF_COUNTER_COUNT];
+    int opened;
+    uint64_t calls[PERF_REGION_MAX];
+    uint64_t counts[PERF_REGION_MAX][PERF_COUNTER_COUNT];
+} perf_thread;
+
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static perf_thread* perf_threads;
+static __thread perf_thread* perf_self;
+static pthread_key_t perf_key;
+static pthread_once_t perf_key_once = PTHREAD_ONCE_INIT;
+static const char* perf_regions[PERF_REGION_MAX];
+static int perf_region_count;
+// opened by at least one thread
+static bool perf_opened[PERF_COUNTER_COUNT];
+
+/// @brief closes an exiting thread's counters, its numbers are kept
+static void perf_thread_exit(void* arg) {
+    perf_thread* thread = arg;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+        if (thread->fds[i] >= 0) close(thread->fds[i]);
+    thread->group = -1;
+}
+
+static void perf_key_init() { pthread_key_create(&perf_key, perf_thread_exit); }
+
+/// @brief opens the calling thread's counters as one group, skipping the ones
+/// the kernel or the CPU won't give us
+static void perf_open(perf_thread* thread) {
+    thread->group = -1;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = perf_events[i].type;
+        attr.config = perf_events[i].config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        thread->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1,
+                                 thread->group, 0);
+        thread->slots[i] = -1;
+        if (thread->fds[i] < 0) continue;
+        if (thread->group < 0) thread->group = thread->fds[i];
+        thread->slots[i] = thread->opened++;
+        perf_opened[i] = true;
+    }
+}
+
+/// @brief the calling thread's table, set up on first use
+/// @return NULL if out of memory
+static perf_thread* perf_thread_self() {
+    if (perf_self) return perf_self;
+    perf_thread* thread = calloc(1, sizeof(perf_thread));
+    if (!thread) return NULL;
+    pthread_once(&perf_key_once, perf_key_init);
+    pthread_mutex_lock(&perf_lock);
+    perf_open(thread);
+    thread->next = perf_threads;
+    perf_threads = thread;
+    pthread_mutex_unlock(&perf_lock);
+    pthread_setspecific(perf_key, thread);
+    perf_self = thread;
+    return thread;
+}
+
+/// @brief reads every counter of the thread with a single syscall
+/// @param values indexed by perf_counter, counters that aren't open read 0
+static void perf_read(perf_thread* thread, uint64_t* values) {
+    uint64_t group[1 + PERF_COUNTER_COUNT];
+    if (read(thread->group, group, sizeof(group)) < (ssize_t)sizeof(uint64_t))
+        group[0] = 0;
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+        int slot = thread->slots[i];
+        values[i] = (slot >= 0 && (uint64_t)slot < group[0]) ? group[1 + slot] : 0;
+    }
+}
+
+/// @brief the id of the region called name, registering it the first time
+/// @param name must outlive the process, a string literal
+/// @return -1 if there are already PERF_REGION_MAX regions
+int perf_region_id(const char* name) {
+    pthread_mutex_lock(&perf_lock);
+    int id = 0;
+    while (id < perf_region_count && strcmp(perf_regions[id], name)) id++;
+    if (id == perf_region_count) {
+        if (id < PERF_REGION_MAX)
+            perf_regions[perf_region_count++] = name;
+        else
+            id = -1;
+    }
+    pthread_mutex_unlock(&perf_lock);
+    return id;
+}
+
+/// @brief enters a region, see PERF_BEGIN
+/// @param region from perf_region_id
+perf_sample perf_begin(int region) {
+    perf_sample sample = {.region = region};
+    perf_thread* thread = perf_thread_self();
+    if (region >= 0 && thread && thread->group >= 0)
+        perf_read(thread, sample.values);
+    return sample;
+}
+
+/// @brief leaves a region, charging it what the counters moved since
+/// perf_begin
+/// @param sample from perf_begin on the same thread
+void perf_end(const perf_sample* sample) {
+    perf_thread* thread = perf_self;
+    if (sample->region < 0 || !thread) return;
+    thread->calls[sample->region]++;
+    if (thread->group < 0) return;
+    uint64_t values[PERF_COUNTER_COUNT];
+    perf_read(thread, values);
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+        thread->counts[sample->region][i] += values[i] - sample->values[i];
+}
+
+/// @brief true if any thread managed to open the counter
+bool perf_counter_available(perf_counter counter) {
+    pthread_mutex_lock(&perf_lock);
+    bool available = perf_opened[counter];
+    pthread_mutex_unlock(&perf_lock);
+    return available;
+}
+
+/// @brief sums a region over every thread
+/// @param name region name
+/// @param stats set to the totals
+/// @return false if no region is called name
+bool perf_region_stats(const char* name, perf_stats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&perf_lock);
+    int id = 0;
+    while (id < perf_region_count && strcmp(perf_regions[id], name)) id++;
+    bool found = id < perf_region_count;
+    for (perf_thread* thread = perf_threads; found && thread; thread = thread->next) {
+        stats->calls += thread->calls[id];
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+            stats->counts[i] += thread->counts[id][i];
+    }
+    pthread_mutex_unlock(&perf_lock);
+    return found;
+}
+
+/// @brief prints calls and the average of every counter per call for each
+/// region that was entered. Numbers are only exact while no thread is
+/// inside a region
+/// @param out where to print
+void perf_report(FILE* out) {
+    pthread_mutex_lock(&perf_lock);
+    int threads = 0;
+    for (perf_thread* thread = perf_threads; thread; thread = thread->next)
+        threads++;
+    fprintf(out, "%-20s %10s", "region", "calls");
+    for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+        fprintf(out, " %14s", perf_events[i].name);
+    fprintf(out, "\n");
+    for (int id = 0; id < perf_region_count; id++) {
+        perf_stats stats = {0};
+        for (perf_thread* thread = perf_threads; thread; thread = thread->next) {
+            stats.calls += thread->calls[id];
+            for (int i = 0; i < PERF_COUNTER_COUNT; i++)
+                stats.counts[i] += thread->counts[id][i];
+        }
+        if (!stats.calls) continue;
+        fprintf(out, "%-20s %10llu", perf_regions[id],
+                (unsigned long long)stats.calls);
+        for (int i = 0; i < PERF_COUNTER_COUNT; i++) {
+            if (perf_opened[i])
+                fprintf(out, " %14.1f", (double)stats.counts[i] / stats.calls);
+            else
+                fprintf(out, " %14s", "-");
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "per call averages over %d thread%s\n", threads,
+            threads == 1 ? "" : "s");
+    if (threads && !perf_opened[PERF_CYCLES] && !perf_opened[PERF_INSTRUCTIONS])
+        fprintf(out, "perf events unavailable, only calls were counted\n");
+    pthread_mutex_unlock(&perf_lock);
+}
+
+/// @brief zeroes every region of every thread
+void perf_reset() {
+    pthread_mutex_lock(&perf_lock);
+    for (perf_thread* thread = perf_threads; thread; thread = thread->next) {
+        memset(thread->calls, 0, sizeof(thread->calls));
+        memset(thread->counts, 0, sizeof(thread->counts));
+    }
+    pthread_mutex_unlock(&perf_lock);
+}
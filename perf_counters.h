@@ -0,0 +1,64 @@
+// perf_counters.h
+// Hardware counters around named regions of the memory manager and the
+// lists, built in with -DMEM_PERF. Every thread counts into its own table and
+// perf_report sums them per region. Where perf events aren't permitted, e.g.
+// by kernel.perf_event_paranoid or inside a VM, regions only count calls.
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum perf_counter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_DTLB_MISSES,
+    PERF_COUNTER_COUNT
+} perf_counter;
+
+// totals for a region over every thread
+typedef struct perf_stats {
+    uint64_t calls;
+    uint64_t counts[PERF_COUNTER_COUNT];
+} perf_stats;
+
+// the counters as they were when a region was entered
+typedef struct perf_sample {
+    int region;
+    uint64_t values[PERF_COUNTER_COUNT];
+} perf_sample;
+
+int perf_region_id(const char* name);
+
+perf_sample perf_begin(int region);
+
+void perf_end(const perf_sample* sample);
+
+bool perf_counter_available(perf_counter counter);
+
+bool perf_region_stats(const char* name, perf_stats* stats);
+
+void perf_report(FILE* out);
+
+void perf_reset();
+
+// PERF_BEGIN and PERF_END bracket a region within one function, and compile
+// to nothing without MEM_PERF. Threads that race to look up the region's id
+// all get the same one
+#ifdef MEM_PERF
+#define PERF_BEGIN(name)                                              \
+    static int perf_region_ = -1;                                     \
+    int perf_id_ = __atomic_load_n(&perf_region_, __ATOMIC_ACQUIRE);  \
+    if (perf_id_ < 0) {                                               \
+        perf_id_ = perf_region_id(name);                              \
+        __atomic_store_n(&perf_region_, perf_id_, __ATOMIC_RELEASE);  \
+    }                                                                 \
+    perf_sample perf_sample_ = perf_begin(perf_id_)
+#define PERF_END() perf_end(&perf_sample_)
+#else
+#define PERF_BEGIN(name)
+#define PERF_END()
+#endif
+
+#endif
@@ -0,0 +1,159 @@
+#include "compact_list.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common_defs.h"
+
+void test_clist_node_size()
+{
+    printf_yellow(" Testing compact node size ---> ");
+    my_assert(sizeof(CNode) == 8);
+    printf_green("[PASS].\n");
+}
+
+void test_clist_insert()
+{
+    printf_yellow(" Testing clist_insert and clist_insert_after ---> ");
+    uint32_t head;
+    clist_init(&head, sizeof(CNode) * 3);
+    my_assert(head == 0);
+    clist_insert(&head, 10);
+    clist_insert(&head, 30);
+    clist_insert_after(head, 20);
+    my_assert(clist_node(head)->data == 10);
+    my_assert(clist_node(clist_node(head)->next)->data == 20);
+    my_assert(clist_count_nodes(&head) == 3);
+    clist_cleanup(&head);
+    my_assert(head == 0);
+    printf_green("[PASS].\n");
+}
+
+void test_clist_delete()
+{
+    printf_yellow(" Testing clist_delete ---> ");
+    uint32_t head;
+    clist_init(&head, sizeof(CNode) * 3);
+    clist_insert(&head, 10);
+    clist_insert(&head, 20);
+    clist_insert(&head, 30);
+    clist_delete(&head, 20);
+    my_assert(clist_count_nodes(&head) == 2);
+    clist_delete(&head, 10);
+    my_assert(clist_node(head)->data == 30);
+    clist_delete(&head, 99);
+    clist_delete(&head, 30);
+    my_assert(head == 0);
+    clist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_clist_search()
+{
+    printf_yellow(" Testing clist_search ---> ");
+    uint32_t head;
+    clist_init(&head, sizeof(CNode) * 2);
+    clist_insert(&head, 10);
+    clist_insert(&head, 20);
+    my_assert(clist_node(clist_search(&head, 20))->data == 20);
+    my_assert(clist_search(&head, 30) == 0);
+    clist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_clist_loop(int count)
+{
+    printf_yellow(" Testing many compact nodes ---> ");
+    uint32_t head;
+    clist_init(&head, sizeof(CNode) * count);
+    clist_insert(&head, 0);
+    uint32_t tail = head;
+    for (int i = 1; i < count; i++)
+    {
+        clist_insert_after(tail, i);
+        tail = clist_node(tail)->next;
+        my_assert(tail != 0);
+    }
+    my_assert(clist_count_nodes(&head) == count);
+    int expected = 0;
+    for (uint32_t walker = head; walker; walker = clist_node(walker)->next)
+        my_assert(clist_node(walker)->data == expected++);
+    for (int i = 0; i < count; i += 2)
+        clist_delete(&head, i);
+    my_assert(clist_count_nodes(&head) == count / 2);
+    clist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_clist_snapshot(int count)
+{
+    printf_yellow(" Testing compact list snapshot and restore ---> ");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_compact_list_%d.snap", getpid());
+    uint32_t head;
+    clist_init(&head, sizeof(CNode) * count);
+    for (int i = 0; i < count; i++)
+        clist_insert(&head, i);
+    my_assert(clist_snapshot(&head, path));
+    clist_cleanup(&head);
+    my_assert(clist_restore(&head, path));
+    my_assert(clist_count_nodes(&head) == count);
+    my_assert(clist_node(clist_search(&head, count - 1))->data == count - 1);
+    clist_cleanup(&head);
+    unlink(path);
+    printf_green("[PASS].\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <test function>\n", argv[0]);
+        printf("Available test functions:\n");
+        printf(" 1. test_clist_node_size - Test that nodes are 8 bytes\n");
+        printf(" 2. test_clist_insert - Test appending and insert after\n");
+        printf(" 3. test_clist_delete - Test delete operation\n");
+        printf(" 4. test_clist_search - Test search for a particular node\n");
+        printf(" 5. test_clist_loop - Test many insertions and deletions\n");
+        printf(" 6. test_clist_snapshot - Test saving a list to a file and restoring it\n");
+        printf(" 0. Run all tests\n");
+        return 1;
+    }
+
+    switch (atoi(argv[1]))
+    {
+    case 0:
+        printf("Testing Compact List:\n");
+        test_clist_node_size();
+        test_clist_insert();
+        test_clist_delete();
+        test_clist_search();
+        test_clist_loop(1000);
+        test_clist_snapshot(1000);
+        break;
+    case 1:
+        test_clist_node_size();
+        break;
+    case 2:
+        test_clist_insert();
+        break;
+    case 3:
+        test_clist_delete();
+        break;
+    case 4:
+        test_clist_search();
+        break;
+    case 5:
+        test_clist_loop(1000);
+        break;
+    case 6:
+        test_clist_snapshot(1000);
+        break;
+
+    default:
+        printf("Invalid test function\n");
+        break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "doubly_linked_list.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "common_defs.h"
+
+// Walks the list both ways checking that the links agree
+void check_links(DNode **head, int count)
+{
+    my_assert(dlist_count_nodes(head) == count);
+    if (count == 0)
+    {
+        my_assert(*head == NULL);
+        return;
+    }
+    DNode *walker = *head;
+    while (walker->next)
+    {
+        my_assert(walker->next->prev == walker);
+        walker = walker->next;
+    }
+    my_assert(dlist_tail(head) == walker);
+    int backwards = 1;
+    while (walker != *head)
+    {
+        walker = walker->prev;
+        backwards++;
+    }
+    my_assert(backwards == count);
+}
+
+void test_dlist_insert()
+{
+    printf_yellow(" Testing dlist_insert and dlist_insert_after ---> ");
+    DNode *head = NULL;
+    dlist_init(&head, sizeof(DNode) * 4);
+    dlist_insert(&head, 10);
+    dlist_insert(&head, 30);
+    dlist_insert_after(&head, head, 20);
+    dlist_insert_after(&head, dlist_tail(&head), 40);
+    my_assert(head->data == 10);
+    my_assert(head->next->data == 20);
+    my_assert(dlist_tail(&head)->data == 40);
+    check_links(&head, 4);
+    dlist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_dlist_insert_before()
+{
+    printf_yellow(" Testing dlist_insert_before ---> ");
+    DNode *head = NULL;
+    dlist_init(&head, sizeof(DNode) * 4);
+    dlist_insert(&head, 20);
+    dlist_insert(&head, 40);
+    dlist_insert_before(&head, head, 10);
+    my_assert(head->data == 10);
+    dlist_insert_before(&head, dlist_tail(&head), 30);
+    my_assert(dlist_tail(&head)->prev->data == 30);
+    check_links(&head, 4);
+    dlist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_dlist_delete()
+{
+    printf_yellow(" Testing dlist_delete and dlist_delete_node ---> ");
+    DNode *head = NULL;
+    dlist_init(&head, sizeof(DNode) * 4);
+    for (int i = 1; i <= 4; i++)
+        dlist_insert(&head, i * 10);
+    dlist_delete_node(&head, head->next); // middle
+    check_links(&head, 3);
+    dlist_delete_node(&head, dlist_tail(&head)); // last
+    my_assert(dlist_tail(&head)->data == 30);
+    check_links(&head, 2);
+    dlist_delete(&head, 10); // first
+    my_assert(head->data == 30);
+    check_links(&head, 1);
+    dlist_delete(&head, 99); // missing
+    dlist_delete(&head, 30);
+    check_links(&head, 0);
+    dlist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_dlist_search()
+{
+    printf_yellow(" Testing dlist_search ---> ");
+    DNode *head = NULL;
+    dlist_init(&head, sizeof(DNode) * 2);
+    dlist_insert(&head, 10);
+    dlist_insert(&head, 20);
+    my_assert(dlist_search(&head, 20)->data == 20);
+    my_assert(dlist_search(&head, 30) == NULL);
+    dlist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_dlist_positional_edits(int count)
+{
+    printf_yellow(" Testing positional edits ---> ");
+    DNode *head = NULL;
+    dlist_init(&head, sizeof(DNode) * count * 2);
+    for (int i = 0; i < count; i++)
+        dlist_insert(&head, i * 2 + 1);
+    // Put an even number before every odd one, then drop the odd ones
+    for (DNode *walker = head; walker; walker = walker->next)
+        dlist_insert_before(&head, walker, walker->data - 1);
+    check_links(&head, count * 2);
+    DNode *walker = head;
+    while (walker)
+    {
+        DNode *next = walker->next;
+        if (walker->data % 2)
+            dlist_delete_node(&head, walker);
+        walker = next;
+    }
+    check_links(&head, count);
+    int expected = 0;
+    for (walker = head; walker; walker = walker->next, expected += 2)
+        my_assert(walker->data == expected);
+    dlist_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <test function>\n", argv[0]);
+        printf("Available test functions:\n");
+        printf(" 1. test_dlist_insert - Test appending and insert after\n");
+        printf(" 2. test_dlist_insert_before - Test insert before a given node\n");
+        printf(" 3. test_dlist_delete - Test deleting by value and by node\n");
+        printf(" 4. test_dlist_search - Test search for a particular node\n");
+        printf(" 5. test_dlist_positional_edits - Test many inserts and deletes by node\n");
+        printf(" 0. Run all tests\n");
+        return 1;
+    }
+
+    switch (atoi(argv[1]))
+    {
+    case 0:
+        printf("Testing Doubly Linked List:\n");
+        test_dlist_insert();
+        test_dlist_insert_before();
+        test_dlist_delete();
+        test_dlist_search();
+        test_dlist_positional_edits(1000);
+        break;
+    case 1:
+        test_dlist_insert();
+        break;
+    case 2:
+        test_dlist_insert_before();
+        break;
+    case 3:
+        test_dlist_delete();
+        break;
+    case 4:
+        test_dlist_search();
+        break;
+    case 5:
+        test_dlist_positional_edits(1000);
+        break;
+
+    default:
+        printf("Invalid test function\n");
+        break;
+    }
+
+    return 0;
+}
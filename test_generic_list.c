@@ -0,0 +1,138 @@
+#include "generic_list.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "common_defs.h"
+
+typedef struct record
+{
+    uint64_t id;
+    char name[56];
+} record;
+
+static int record_equals(const record *a, const record *b)
+{
+    return a->id == b->id;
+}
+
+#define RECORD_EQUALS(a, b) record_equals((a), (b))
+
+GENERIC_LIST(record_list, record, RECORD_EQUALS)
+
+typedef struct point
+{
+    int32_t x, y;
+} point;
+
+GENERIC_LIST(point_list, point, GENERIC_LIST_EQ_BYTES)
+
+void test_glist_default()
+{
+    printf_yellow(" Testing the uint16_t instantiation ---> ");
+    u16_list_node *head;
+    u16_list_init(&head, sizeof(u16_list_node) * 4);
+    for (uint16_t i = 10; i <= 30; i += 10)
+        u16_list_insert(&head, &i);
+    uint16_t value = 20;
+    my_assert(u16_list_search(&head, &value)->data == 20);
+    value = 15;
+    u16_list_insert_after(head, &value);
+    my_assert(head->next->data == 15);
+    u16_list_delete(&head, &value);
+    my_assert(u16_list_count_nodes(&head) == 3);
+    u16_list_cleanup(&head);
+    my_assert(head == NULL);
+    printf_green("[PASS].\n");
+}
+
+void test_glist_records(int count)
+{
+    printf_yellow(" Testing 64 byte records stored inline ---> ");
+    my_assert(sizeof(record) == 64);
+    record_list_node *head;
+    record_list_init(&head, sizeof(record_list_node) * (count + 1));
+    record r;
+    for (int i = 0; i < count; i++)
+    {
+        r.id = i;
+        snprintf(r.name, sizeof(r.name), "record %d", i);
+        record_list_insert(&head, &r);
+    }
+    my_assert(record_list_count_nodes(&head) == count);
+
+    // found by id only, with the payload right in the node
+    r.id = count / 2;
+    strcpy(r.name, "ignored");
+    record_list_node *found = record_list_search(&head, &r);
+    my_assert(found != NULL);
+    char expected[56];
+    snprintf(expected, sizeof(expected), "record %d", count / 2);
+    my_assert(strcmp(found->data.name, expected) == 0);
+    my_assert(mem_usable_size(found) >= sizeof(record_list_node));
+
+    r.id = count + 1;
+    record_list_insert_before(&head, found, &r);
+    my_assert(record_list_search(&head, &r)->next == found);
+    record_list_delete(&head, &r);
+    r.id = 0;
+    record_list_delete(&head, &r);
+    my_assert(head->data.id == 1);
+    my_assert(record_list_count_nodes(&head) == count - 1);
+    record_list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_glist_bytes()
+{
+    printf_yellow(" Testing byte wise comparison ---> ");
+    point_list_node *head;
+    point_list_init(&head, sizeof(point_list_node) * 2);
+    point p = {1, 2};
+    point_list_insert(&head, &p);
+    p.y = 3;
+    point_list_insert(&head, &p);
+    my_assert(point_list_search(&head, &p) == head->next);
+    p.x = 5;
+    my_assert(point_list_search(&head, &p) == NULL);
+    point_list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <test function>\n", argv[0]);
+        printf("Available test functions:\n");
+        printf(" 1. test_glist_default - Test the uint16_t list\n");
+        printf(" 2. test_glist_records - Test a list of 64 byte records\n");
+        printf(" 3. test_glist_bytes - Test comparing elements byte by byte\n");
+        printf(" 0. Run all tests\n");
+        return 1;
+    }
+
+    switch (atoi(argv[1]))
+    {
+    case 0:
+        printf("Testing Generic List:\n");
+        test_glist_default();
+        test_glist_records(1000);
+        test_glist_bytes();
+        break;
+    case 1:
+        test_glist_default();
+        break;
+    case 2:
+        test_glist_records(1000);
+        break;
+    case 3:
+        test_glist_bytes();
+        break;
+
+    default:
+        printf("Invalid test function\n");
+        break;
+    }
+
+    return 0;
+}
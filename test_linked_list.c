@@ -2,9 +2,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "common_defs.h"
 
+#ifdef MEM_PERF
+#include "perf_counters.h"
+#endif
+
 // Function to capture stdout output.
 void capture_stdout(char *buffer, size_t size, void (*func)(Node **, Node *, Node *), Node **head, Node *start_node, Node *end_node)
 {
@@ -323,6 +329,427 @@ void test_list_edge_cases()
     printf_green("[PASS].\n");
 }
 
+void test_list_arena(int count)
+{
+    printf_yellow(" Testing arena backed list ---> ");
+    Node *head = NULL;
+    list_init_arena(&head, sizeof(Node) * count);
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            list_insert_after(head, i); // Order does not matter here
+            if (head == NULL)
+                list_insert(&head, i);
+        }
+        my_assert(list_count_nodes(&head) == count);
+        list_delete(&head, 0);
+        my_assert(list_count_nodes(&head) == count - 1);
+
+        // Dropping the list makes room for the next round
+        list_discard(&head);
+        my_assert(head == NULL);
+    }
+
+    list_insert(&head, 10);
+    my_assert(head->data == 10);
+    list_cleanup(&head);
+    my_assert(head == NULL);
+    printf_green("[PASS].\n");
+}
+
+void test_list_ordering(int count)
+{
+    printf_yellow(" Testing list ordering operations ---> ");
+    Node *head = NULL;
+    Node *other = NULL;
+    list_init(&head, sizeof(Node) * count * 2);
+
+    // Short lists take the merge sort, long ones the radix sort
+    int sizes[] = {1, 2, 17, 255, count};
+    for (int s = 0; s < 5; s++)
+    {
+        srand(s);
+        for (int i = 0; i < sizes[s]; i++)
+        {
+            if (head == NULL)
+                list_insert(&head, rand() % 100 * 600);
+            else
+                list_insert_after(head, rand() % 100 * 600);
+        }
+        list_sort(&head);
+        my_assert(list_count_nodes(&head) == sizes[s]);
+        for (Node *walker = head; walker->next; walker = walker->next)
+            my_assert(walker->data <= walker->next->data);
+
+        list_unique(&head);
+        for (Node *walker = head; walker->next; walker = walker->next)
+            my_assert(walker->data < walker->next->data);
+
+        while (head)
+            list_delete(&head, head->data);
+    }
+
+    // Reverse
+    for (int i = 0; i < 10; i++)
+        list_insert(&head, i);
+    list_reverse(&head);
+    int expected = 9;
+    for (Node *walker = head; walker; walker = walker->next)
+        my_assert(walker->data == expected--);
+    my_assert(expected == -1);
+
+    // Merge two sorted lists
+    list_sort(&head);
+    for (int i = 0; i < 10; i += 3)
+        list_insert(&other, i);
+    list_merge_sorted(&head, &other);
+    my_assert(other == NULL);
+    my_assert(list_count_nodes(&head) == 14);
+    for (Node *walker = head; walker->next; walker = walker->next)
+        my_assert(walker->data <= walker->next->data);
+    list_unique(&head);
+    my_assert(list_count_nodes(&head) == 10);
+
+    list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+static void sum_node(Node *node, void *ctx)
+{
+    *(int *)ctx += node->data;
+}
+
+void test_list_iterators(int count)
+{
+    printf_yellow(" Testing list cursors and bulk reads ---> ");
+    Node *head = NULL;
+    list_init(&head, sizeof(Node) * count);
+    for (int i = 0; i < count; i++)
+        list_insert(&head, i);
+
+    // Cursor sees every value in order
+    list_cursor cursor = list_cursor_init(&head);
+    uint16_t value;
+    int expected = 0;
+    while (list_cursor_next(&cursor, &value))
+        my_assert(value == expected++);
+    my_assert(expected == count);
+    my_assert(!list_cursor_next(&cursor, &value));
+
+    // for_each visits every node once
+    int sum = 0;
+    list_for_each(&head, sum_node, &sum);
+    my_assert(sum == count * (count - 1) / 2);
+
+    // Copy out, bounded by n and by the list
+    uint16_t values[count + 10];
+    my_assert(list_copy_to_array(&head, values, 10) == 10);
+    my_assert(values[9] == 9);
+    my_assert(list_copy_to_array(&head, values, count + 10) == (size_t)count);
+    my_assert(values[count - 1] == count - 1);
+
+    list_cleanup(&head);
+    cursor = list_cursor_init(&head);
+    my_assert(!list_cursor_next(&cursor, &value));
+    my_assert(list_copy_to_array(&head, values, 10) == 0);
+    printf_green("[PASS].\n");
+}
+
+void test_list_snapshot(int count)
+{
+    printf_yellow(" Testing list snapshot and restore ---> ");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_linked_list_%d.snap", getpid());
+    Node *head = NULL;
+    list_init(&head, sizeof(Node) * count);
+    for (int i = 0; i < count; i++)
+        list_insert(&head, i);
+    my_assert(list_snapshot(&head, path));
+    void *old = head;
+    list_cleanup(&head);
+
+    // Keeping the old address taken forces the links to be relocated
+    size_t page = sysconf(_SC_PAGESIZE);
+    void *taken = (void *)((uintptr_t)old & ~(page - 1));
+    my_assert(mmap(taken, page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0) == taken);
+    my_assert(list_restore(&head, path));
+    my_assert((void *)head != old);
+    my_assert(list_count_nodes(&head) == count);
+    int expected = 0;
+    for (Node *walker = head; walker; walker = walker->next)
+        my_assert(walker->data == expected++);
+    list_insert(&head, count);
+    list_delete(&head, 0);
+    my_assert(list_count_nodes(&head) == count);
+
+    // Restoring into the address it was taken at
+    list_cleanup(&head);
+    munmap(taken, page);
+    my_assert(list_restore(&head, path));
+    my_assert((void *)head == old);
+    my_assert(list_count_nodes(&head) == count);
+    my_assert(!list_restore(&head, "/nonexistent/snapshot"));
+    my_assert(list_count_nodes(&head) == count);
+    list_cleanup(&head);
+    unlink(path);
+    printf_green("[PASS].\n");
+}
+
+void test_list_cleanup_async(int count)
+{
+    printf_yellow(" Testing list_cleanup_async ---> ");
+    Node *head = NULL;
+    list_init(&head, sizeof(Node) * count);
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < count; i++)
+            list_insert_after(head, i);
+        if (head == NULL)
+            list_insert(&head, count);
+        list_cleanup_async(&head);
+        my_assert(head == NULL);
+        // every node is back once the reclaimer is done
+        mem_flush_deferred();
+        mem_stats stats;
+        mem_get_stats(&stats);
+        my_assert(stats.used_blocks == 0);
+    }
+    list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_list_insert_many(int count)
+{
+    printf_yellow(" Testing list_insert_many ---> ");
+    uint16_t *values = malloc(sizeof(uint16_t) * count);
+    for (int i = 0; i < count; i++)
+        values[i] = i;
+    for (int arena = 0; arena < 2; arena++)
+    {
+        Node *head = NULL;
+        if (arena)
+            list_init_arena(&head, sizeof(Node) * count);
+        else
+            list_init(&head, sizeof(Node) * count);
+        list_insert(&head, 0);
+        list_insert_many(&head, values + 1, count - 1);
+        my_assert(list_count_nodes(&head) == count);
+        int i = 0;
+        for (Node *walker = head; walker; walker = walker->next)
+            my_assert(walker->data == i++);
+        // the pool is full, nothing more is added
+        list_insert_many(&head, values, count);
+        my_assert(list_count_nodes(&head) <= count + 1);
+        list_cleanup(&head);
+    }
+    free(values);
+    printf_green("[PASS].\n");
+}
+
+void test_list_search_many(int count)
+{
+    printf_yellow(" Testing list_search_many ---> ");
+    Node *head = NULL;
+    list_init(&head, sizeof(Node) * (count + 1));
+    for (int i = 0; i < count; i++)
+        list_insert(&head, i * 2);
+    list_insert(&head, 0); // a duplicate, the first one is found
+
+    // more keys than a single traversal answers, with misses and repeats
+    int n = 3000;
+    uint16_t *keys = malloc(sizeof(uint16_t) * n);
+    Node **results = malloc(sizeof(Node *) * n);
+    for (int i = 0; i < n; i++)
+        keys[i] = (i * 7) % (count * 3);
+    list_search_many(&head, keys, n, results);
+    for (int i = 0; i < n; i++)
+        my_assert(results[i] == list_search(&head, keys[i]));
+    my_assert(results[0] == head);
+
+    list_search_many(&head, keys, 0, results);
+    Node *empty = NULL;
+    list_search_many(&empty, keys, 10, results);
+    for (int i = 0; i < 10; i++)
+        my_assert(results[i] == NULL);
+    free(keys);
+    free(results);
+    list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+static Node *node_with(Node *head, uint16_t data)
+{
+    while (head && head->data != data)
+        head = head->next;
+    return head;
+}
+
+void test_list_persistent(int count)
+{
+    printf_yellow(" Testing persistent lists ---> ");
+    Node *head = NULL;
+    list_init_persistent(&head, sizeof(Node) * count * 4);
+    for (int i = 0; i < count; i++)
+        list_insert(&head, i);
+
+    // Cloning shares every node
+    Node *clone = list_clone(&head);
+    my_assert(clone == head && mem_refcount(head) == 2);
+
+    // Deleting copies only the nodes before the change
+    list_delete(&head, 5);
+    my_assert(list_count_nodes(&head) == count - 1);
+    my_assert(list_count_nodes(&clone) == count);
+    my_assert(node_with(clone, 5) != NULL && node_with(head, 5) == NULL);
+    my_assert(head != clone && node_with(head, 4) != node_with(clone, 4));
+    my_assert(node_with(head, 6) == node_with(clone, 6));
+
+    // As does inserting before a node
+    Node *second = list_clone(&clone);
+    list_insert_before(&second, node_with(second, 10), 5000);
+    my_assert(node_with(second, 5000)->next == node_with(clone, 10));
+    my_assert(node_with(clone, 5000) == NULL);
+    list_insert_after(second, 1); // not for persistent lists
+    my_assert(list_count_nodes(&second) == count + 1);
+
+    // Appending copies the whole path, the original keeps its end
+    list_insert(&clone, 6000);
+    my_assert(node_with(clone, 6000) != NULL && node_with(second, 6000) == NULL);
+
+    // Changing a list in place leaves the others alone
+    list_reverse(&second);
+    my_assert(second->data == count - 1 && head->data == 0 && clone->data == 0);
+    list_sort(&second);
+    my_assert(second->data == 0 && list_count_nodes(&second) == count + 1);
+
+    // Nodes go once the last list is released
+    list_release(&clone);
+    list_release(&second);
+    my_assert(list_count_nodes(&head) == count - 1);
+    int i = 0;
+    for (Node *walker = head; walker; walker = walker->next, i++)
+        my_assert(walker->data == (i < 5 ? i : i + 1));
+    list_release(&head);
+    mem_stats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 0);
+    list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+void test_list_restructure(int count)
+{
+    printf_yellow(" Testing splice, split and range deletes ---> ");
+    Node *head = NULL;
+    Node *other = NULL;
+    list_init(&head, sizeof(Node) * count * 2);
+    for (int i = 0; i < count; i++)
+    {
+        list_insert(&head, i);
+        list_insert(&other, count + i);
+    }
+
+    // Concatenating moves the nodes without allocating
+    mem_stats before, after;
+    mem_get_stats(&before);
+    list_concat(&head, &other);
+    mem_get_stats(&after);
+    my_assert(other == NULL && list_count_nodes(&head) == count * 2);
+    my_assert(after.used_blocks == before.used_blocks);
+    Node *last = node_with(head, count - 1);
+    my_assert(last->next->data == count);
+
+    // Splitting after a node hands back the rest
+    other = list_split_at(last);
+    my_assert(last->next == NULL && other->data == count);
+    my_assert(list_count_nodes(&head) == count && list_count_nodes(&other) == count);
+    my_assert(list_split_at(NULL) == NULL);
+
+    // Splicing in the middle and at the front
+    Node *front = list_split_at(node_with(other, count + 9));
+    list_splice(&head, node_with(head, 4), &other);
+    my_assert(other == NULL && node_with(head, 4)->next->data == count);
+    my_assert(node_with(head, count + 9)->next->data == 5);
+    list_splice(&head, NULL, &front);
+    my_assert(front == NULL && head->data == count + 10);
+    my_assert(list_count_nodes(&head) == count * 2);
+
+    // Deleting the spliced ranges again frees their nodes
+    list_delete_range(&head, head, node_with(head, count * 2 - 1));
+    list_delete_range(&head, node_with(head, count), node_with(head, count + 9));
+    my_assert(list_count_nodes(&head) == count);
+    int i = 0;
+    for (Node *walker = head; walker; walker = walker->next, i++)
+        my_assert(walker->data == i);
+    mem_get_stats(&after);
+    my_assert(after.used_blocks == (size_t)count);
+
+    // A range has to run forwards, and NULL ends it at the tail
+    list_delete_range(&head, node_with(head, 10), node_with(head, 5));
+    my_assert(list_count_nodes(&head) == count);
+    list_delete_range(&head, node_with(head, 10), NULL);
+    my_assert(list_count_nodes(&head) == 10 && node_with(head, 9)->next == NULL);
+    list_cleanup(&head);
+
+    // Persistent lists copy the path to the change and keep shared nodes
+    list_init_persistent(&head, sizeof(Node) * count * 4);
+    for (int i = 0; i < count; i++)
+        list_insert(&head, i);
+    Node *clone = list_clone(&head);
+    list_delete_range(&head, node_with(head, 10), node_with(head, 19));
+    my_assert(list_count_nodes(&head) == count - 10);
+    my_assert(list_count_nodes(&clone) == count);
+    my_assert(node_with(head, 20) == node_with(clone, 20));
+    other = list_clone(&clone);
+    list_splice(&head, node_with(head, 9), &other);
+    my_assert(list_count_nodes(&head) == count * 2 - 10);
+    my_assert(list_count_nodes(&clone) == count);
+    my_assert(list_split_at(head) == NULL); // not for persistent lists
+    other = list_clone(&clone);
+    list_concat(&clone, &other);
+    my_assert(list_count_nodes(&clone) == count * 2);
+    list_release(&clone);
+    list_release(&head);
+    mem_get_stats(&after);
+    my_assert(after.used_blocks == 0);
+    list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+
+#ifdef MEM_PERF
+void test_list_perf_regions(int count)
+{
+    printf_yellow(" Testing perf counter regions of the list ---> ");
+    Node *head = NULL;
+    list_init(&head, sizeof(Node) * count * 2);
+    perf_reset();
+    for (int i = 0; i < count; i++)
+        list_insert(&head, i);
+    for (int i = 0; i < count; i += 2)
+        my_assert(list_search(&head, i) != NULL);
+    for (int i = 0; i < count; i += 2)
+        list_delete(&head, i);
+
+    // Calls are counted whether or not perf events are permitted
+    perf_stats stats;
+    my_assert(perf_region_stats("list_insert", &stats));
+    my_assert(stats.calls == (uint64_t)count);
+    my_assert(perf_region_stats("list_search", &stats));
+    my_assert(stats.calls == (uint64_t)(count + 1) / 2);
+    my_assert(perf_region_stats("list_delete", &stats));
+    my_assert(stats.calls == (uint64_t)(count + 1) / 2);
+    if (perf_counter_available(PERF_INSTRUCTIONS))
+        my_assert(stats.counts[PERF_INSTRUCTIONS] > 0);
+
+    // The allocator's own regions nest inside the list's
+    my_assert(perf_region_stats("mem_alloc", &stats));
+    my_assert(stats.calls == (uint64_t)count);
+    list_cleanup(&head);
+    printf_green("[PASS].\n");
+}
+#endif
+
 // Main function to run all tests
 int main(int argc, char *argv[])
 {
@@ -347,6 +774,16 @@ int main(int argc, char *argv[])
         printf(" 12. test_list_delete_loop - Test multiple detelions\n");
         printf(" 13. test_list_search_loop - Test multiple search\n");
         printf(" 14. test_list_edge_cases - Test edge cases\n");
+        printf(" 15. test_list_arena - Test arena backed lists\n");
+        printf(" 16. test_list_ordering - Test sort, reverse, merge and unique\n");
+        printf(" 17. test_list_iterators - Test cursors, for_each and copying out\n");
+        printf(" 18. test_list_snapshot - Test saving a list to a file and restoring it\n");
+        printf(" 19. test_list_cleanup_async - Test freeing the nodes in the background\n");
+        printf(" 20. test_list_insert_many - Test inserting many nodes at once\n");
+        printf(" 21. test_list_search_many - Test looking up many values in one traversal\n");
+        printf(" 22. test_list_persistent - Test clones sharing their nodes\n");
+        printf(" 23. test_list_restructure - Test splice, split, concat and range deletes\n");
+        printf(" 24. test_list_perf_regions - Test perf counter regions, MEM_PERF builds only\n");
         printf(" 0. Run all tests\n");
         return 1;
     }
@@ -371,6 +808,15 @@ int main(int argc, char *argv[])
         test_list_delete_loop(1000);
         test_list_search_loop(1000);
         test_list_edge_cases();
+        test_list_arena(1000);
+        test_list_ordering(1000);
+        test_list_iterators(1000);
+        test_list_snapshot(1000);
+        test_list_cleanup_async(1000);
+        test_list_insert_many(1000);
+        test_list_search_many(1000);
+        test_list_persistent(1000);
+        test_list_restructure(1000);
         break;
     case 1:
         test_list_init();
@@ -415,6 +861,38 @@ int main(int argc, char *argv[])
     case 14:
         test_list_edge_cases();
         break;
+    case 15:
+        test_list_arena(1000);
+        break;
+    case 16:
+        test_list_ordering(1000);
+        break;
+    case 17:
+        test_list_iterators(1000);
+        break;
+    case 18:
+        test_list_snapshot(1000);
+        break;
+    case 19:
+        test_list_cleanup_async(1000);
+        break;
+    case 20:
+        test_list_insert_many(1000);
+        break;
+    case 21:
+        test_list_search_many(1000);
+        break;
+    case 22:
+        test_list_persistent(1000);
+        break;
+    case 23:
+        test_list_restructure(1000);
+        break;
+#ifdef MEM_PERF
+    case 24:
+        test_list_perf_regions(1000);
+        break;
+#endif
 
     default:
         printf("Invalid test function\n");
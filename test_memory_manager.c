@@ -4,10 +4,27 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include "common_defs.h"
 
 #include "gitdata.h"
 
+// the debug heap puts redzones around every block and keeps freed ones in
+// quarantine, so checks on where blocks land only hold without it
+#ifdef MEM_DEBUG
+#define placement_assert(expr) ((void)0)
+#else
+#define placement_assert(expr) my_assert(expr)
+#endif
+
+#ifdef MEM_PERF
+#include <pthread.h>
+
+#include "perf_counters.h"
+#endif
+
 void test_init()
 {
     printf_yellow("  Testing mem_init ---> ");
@@ -42,7 +59,7 @@ void test_zero_alloc_and_free()
     my_assert(block1 != NULL);
     void *block2 = mem_alloc(200);
     my_assert(block2 != NULL);
-    my_assert(block1 == block2);
+    placement_assert(block1 == block2);
 
     mem_free(block1);
     mem_free(block2);
@@ -160,7 +177,7 @@ void test_exact_fit_reuse()
     void *block1 = mem_alloc(500);
     mem_free(block1);
     void *block2 = mem_alloc(500); // Reuse the exact space freed
-    my_assert(block1 == block2);   // Should be the same address if reused properly
+    placement_assert(block1 == block2);   // Should be the same address if reused properly
 
     mem_free(block2);
     mem_deinit();
@@ -199,7 +216,7 @@ void test_memory_reuse()
     void *block2 = mem_alloc(256);
     mem_free(block1);
     void *block3 = mem_alloc(128); // This should ideally reuse the space from block1
-    my_assert(block3 == block1);   // Check if the same memory is reused
+    placement_assert(block3 == block1);   // Check if the same memory is reused
 
     mem_free(block2);
     mem_free(block3);
@@ -241,7 +258,7 @@ void test_non_contiguous_allocation_failure()
 
     // Attempt to allocate a block larger than any single free block but smaller than the total free space
     void *block4 = mem_alloc(500);
-    my_assert(block4 == NULL); // This allocation should fail due to lack of contiguous space
+    placement_assert(block4 == NULL); // This allocation should fail due to lack of contiguous space
 
     mem_free(block2); // Cleanup
     mem_deinit();
@@ -326,6 +343,905 @@ void test_edge_case_allocations()
     printf_green("[PASS].\n");
 }
 
+void test_grow()
+{
+    printf_yellow("  Testing mem_grow ---> ");
+    mem_options opts = {.max_size = 4096};
+    mem_init_opts(1024, &opts);
+
+    void *block1 = mem_alloc(1024);
+    my_assert(block1 != NULL);
+    my_assert(mem_alloc(512) == NULL); // Pool is full until it grows
+
+    my_assert(mem_grow(1024));
+    void *block2 = mem_alloc(512);
+    my_assert(block2 != NULL);
+    my_assert(mem_owns(block2));
+
+    my_assert(!mem_grow(8192)); // Beyond what was reserved
+
+    mem_free(block1);
+    mem_free(block2);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_aligned_alloc()
+{
+    printf_yellow("  Testing mem_alloc_aligned ---> ");
+    mem_init(4096);
+
+    void *block1 = mem_alloc(10); // Knock the next block off alignment
+    my_assert(block1 != NULL);
+    void *block2 = mem_alloc_aligned(64, 100);
+    my_assert(block2 != NULL);
+    my_assert(((uintptr_t)block2 & 63) == 0);
+    my_assert(mem_usable_size(block2) >= 100);
+
+    // The gap left in front of block2 is still usable
+    void *block3 = mem_alloc(8);
+    my_assert(block3 != NULL);
+    placement_assert(block3 < block2);
+
+    mem_free(block1);
+    mem_free(block2);
+    mem_free(block3);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_placement_policies()
+{
+    printf_yellow("  Testing placement policies ---> ");
+    mem_policy policies[] = {MEM_FIRST_FIT, MEM_NEXT_FIT, MEM_BEST_FIT, MEM_GOOD_FIT};
+    for (int p = 0; p < 4; p++)
+    {
+        mem_options opts = {.policy = policies[p]};
+        mem_init_opts(4096, &opts);
+
+        // Two holes, the first one bigger than needed
+        void *a = mem_alloc(200);
+        void *x1 = mem_alloc(16);
+        void *c = mem_alloc(100);
+        void *x2 = mem_alloc(16);
+        mem_free(a);
+        mem_free(c);
+        void *d = mem_alloc(100);
+        my_assert(d != NULL);
+        if (policies[p] == MEM_FIRST_FIT)
+            placement_assert(d == a);
+        else if (policies[p] == MEM_NEXT_FIT)
+            placement_assert(d > x2); // Carries on after the last allocation
+        else
+            placement_assert(d == c);
+        mem_free(d);
+        mem_free(x1);
+        mem_free(x2);
+
+        // Aligned requests pick their hole the same way
+        a = mem_alloc(400);
+        x1 = mem_alloc(16);
+        c = mem_alloc(200);
+        x2 = mem_alloc(16);
+        mem_free(a);
+        mem_free(c);
+        char *e = mem_alloc_aligned(64, 100);
+        my_assert(e != NULL);
+        my_assert((uintptr_t)e % 64 == 0);
+        if (policies[p] == MEM_FIRST_FIT)
+            placement_assert(e >= (char *)a && e < (char *)a + 400);
+        else if (policies[p] == MEM_NEXT_FIT)
+            placement_assert(e > (char *)x2);
+        else
+            placement_assert(e >= (char *)c && e < (char *)c + 200);
+        mem_free(e);
+        mem_free(x1);
+        mem_free(x2);
+
+        // Neighbours freed in address order still merge
+        void *b1 = mem_alloc(900);
+        void *b2 = mem_alloc(900);
+        void *b3 = mem_alloc(900);
+        void *b4 = mem_alloc(900);
+        my_assert(b4 != NULL);
+        mem_free(b1);
+        mem_free(b2);
+        void *big = mem_alloc(1800);
+        my_assert(big != NULL);
+        mem_free(big);
+        mem_free(b3);
+        mem_free(b4);
+
+        // Random churn, afterwards the pool must be one free stretch again
+        srand(p);
+        void *blocks[64] = {0};
+        for (int i = 0; i < 5000; i++)
+        {
+            int k = rand() % 64;
+            if (blocks[k])
+            {
+                mem_free(blocks[k]);
+                blocks[k] = NULL;
+            }
+            else
+                blocks[k] = mem_alloc(rand() % 120);
+        }
+        for (int k = 0; k < 64; k++)
+            mem_free(blocks[k]);
+        mem_stats stats;
+        mem_get_stats(&stats);
+        placement_assert(stats.free_runs == 1);
+        placement_assert(stats.largest_free >= 4096);
+
+        mem_deinit();
+    }
+    printf_green("[PASS].\n");
+}
+
+static int all_zero(const unsigned char *block, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        if (block[i])
+            return 0;
+    return 1;
+}
+
+void test_calloc()
+{
+    printf_yellow("  Testing mem_calloc ---> ");
+    mem_init(1 << 20);
+    mem_stats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.zero_bytes >= 1 << 19); // Nothing touched yet
+
+    // Dirty memory has to be cleared
+    unsigned char *block1 = mem_alloc(4096);
+    memset(block1, 0xAB, 4096);
+    mem_free(block1);
+    unsigned char *block2 = mem_calloc(1024, 4);
+    placement_assert(block2 == block1);
+    my_assert(all_zero(block2, 4096));
+
+    // Big blocks hand their pages back when freed
+    unsigned char *block3 = mem_alloc(256 << 10);
+    memset(block3, 0xCD, 256 << 10);
+    mem_get_stats(&stats);
+    size_t zero_before = stats.zero_bytes;
+    mem_free(block3);
+    mem_get_stats(&stats);
+    placement_assert(stats.zero_bytes > zero_before);
+    unsigned char *block4 = mem_calloc(256 << 10, 1);
+    my_assert(block4 != NULL);
+    my_assert(all_zero(block4, 256 << 10));
+
+    my_assert(mem_calloc(SIZE_MAX / 2, 4) == NULL); // n * size overflows
+
+    // Aligned, for callers like malloc that promise more than 4 bytes
+    unsigned char *dirty = mem_alloc(1024);
+    memset(dirty, 0x5A, 1024);
+    mem_free(dirty);
+    unsigned char *block5 = mem_calloc_aligned(64, 100, 10);
+    my_assert(block5 != NULL && ((uintptr_t)block5 & 63) == 0);
+    my_assert(all_zero(block5, 1000));
+    my_assert(mem_calloc_aligned(64, SIZE_MAX / 2, 4) == NULL);
+
+    mem_free(block2);
+    mem_free(block4);
+    mem_free(block5);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_resize_zeroed()
+{
+    printf_yellow("  Testing mem_resize_zeroed ---> ");
+    mem_init(1 << 16);
+
+    // Dirty the pool first so nothing is zero by accident
+    unsigned char *dirty = mem_alloc(1 << 15);
+    memset(dirty, 0xEE, 1 << 15);
+    mem_free(dirty);
+
+    unsigned char *block = mem_alloc(16);
+    memset(block, 7, 16);
+    block = mem_resize_zeroed(block, 400); // Grows in place
+    my_assert(block != NULL);
+    for (int i = 0; i < 16; i++)
+        my_assert(block[i] == 7);
+    my_assert(all_zero(block + 16, 400 - 16));
+
+    unsigned char *blocker = mem_alloc(16);
+    memset(block, 9, 400);
+    unsigned char *moved = mem_resize_zeroed(block, 2000); // Has to move
+    my_assert(moved != NULL && moved != block);
+    for (int i = 0; i < 400; i++)
+        my_assert(moved[i] == 9);
+    my_assert(all_zero(moved + 400, 2000 - 400));
+
+    mem_free(blocker);
+    mem_free(moved);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_numa()
+{
+    printf_yellow("  Testing NUMA partitions ---> ");
+    mem_init(1024);
+    my_assert(mem_numa_nodes() == 1);
+    mem_deinit();
+
+    // Whatever the machine has, binding may fail and the pool still works
+    mem_options detected = {.numa = true};
+    mem_init_opts(1 << 16, &detected);
+    my_assert(mem_numa_nodes() >= 1);
+    void *block = mem_alloc(100);
+    my_assert(block != NULL);
+    my_assert(mem_node_of(block) >= 0);
+    mem_free(block);
+    mem_deinit();
+
+    // Pretend there are two nodes
+    mem_options opts = {.numa = true, .numa_nodes = 2};
+    mem_init_opts(1 << 16, &opts);
+    my_assert(mem_numa_nodes() == 2);
+    void *block1 = mem_alloc_node(100, 1);
+    my_assert(block1 != NULL);
+    my_assert(mem_node_of(block1) == 1);
+    void *block0 = mem_alloc_node(100, 0);
+    my_assert(mem_node_of(block0) == 0);
+    my_assert(mem_alloc_node(100, 2) == NULL);
+
+    // A full node falls back to the other one
+    void *fill[64];
+    int filled = 0;
+    while ((fill[filled] = mem_alloc_node(4096, 0)) != NULL)
+        filled++;
+    my_assert(filled > 0 && filled < 64);
+    void *spill = mem_alloc(4096);
+    placement_assert(spill != NULL);
+    placement_assert(mem_node_of(spill) == 1);
+    void *aligned_spill = mem_alloc_aligned(64, 4096);
+    placement_assert(aligned_spill != NULL);
+    placement_assert(mem_node_of(aligned_spill) == 1);
+    mem_free(aligned_spill);
+
+    // Free blocks never merge across nodes
+    for (int i = 0; i < filled; i++)
+        mem_free(fill[i]);
+    mem_free(block0);
+    mem_free(block1);
+    mem_free(spill);
+    mem_stats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 0);
+    placement_assert(stats.free_runs == 2);
+
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_huge_pages()
+{
+    printf_yellow("  Testing huge page backed pools ---> ");
+    size_t huge = 2 << 20;
+    mem_options opts = {.huge_pages = true, .prefault = true};
+    mem_init_opts(4 << 20, &opts);
+
+    // Whichever kind of page it got, the pool starts on a 2 MiB boundary
+    void *block = mem_alloc(16);
+    my_assert(block != NULL);
+    void *pool = block - sizeof(uint32_t);
+#ifdef MEM_DEBUG
+    pool -= 32; // the front redzone
+#endif
+    my_assert(((uintptr_t)pool & (huge - 1)) == 0);
+
+    // Prefaulted, so every page is already resident
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t pages = (4 << 20) / page;
+    unsigned char resident[pages];
+    my_assert(mincore(pool, pages * page, resident) == 0);
+    for (size_t i = 0; i < pages; i++)
+        my_assert(resident[i] & 1);
+
+    // Still zero after faulting in
+    void *zeroed = mem_calloc(1 << 20, 1);
+    my_assert(zeroed != NULL);
+    my_assert(all_zero(zeroed, 1 << 20));
+
+    mem_free(block);
+    mem_free(zeroed);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_shared_heap()
+{
+    printf_yellow("  Testing shared heaps ---> ");
+    char name[64];
+    snprintf(name, sizeof(name), "/test_memory_manager_%d", getpid());
+    mem_options opts = {.shared = true, .shared_name = name};
+    mem_init_opts(4096, &opts);
+    uint32_t *slots = mem_calloc(4, sizeof(uint32_t));
+    my_assert(slots != NULL);
+    mem_set_root(slots);
+
+    // The child attaches by name, likely at another address, and hands a
+    // block back through the root
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        mem_deinit();
+        mem_init_opts(0, &opts);
+        uint32_t *root = mem_get_root();
+        char *message = mem_alloc(16);
+        if (!root || !message)
+            _exit(1);
+        strcpy(message, "from the child");
+        root[0] = mem_offset(message);
+        mem_deinit();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    my_assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    char *message = mem_ptr(slots[0]);
+    my_assert(message != NULL && strcmp(message, "from the child") == 0);
+
+    // What the child allocated is taken here too
+    char *block = mem_alloc(16);
+    my_assert(block != NULL && block != message);
+    mem_stats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 3);
+    mem_free(message);
+    mem_free(block);
+    mem_free(slots);
+    mem_deinit();
+    shm_unlink(name);
+
+    // Unnamed regions are shared with forked children
+    opts.shared_name = NULL;
+    mem_init_opts(4096, &opts);
+    slots = mem_calloc(4, sizeof(uint32_t));
+    my_assert(slots != NULL);
+    pid = fork();
+    if (pid == 0)
+    {
+        for (int i = 0; i < 4; i++)
+            slots[i] = mem_offset(mem_alloc(8));
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+    for (int i = 0; i < 4; i++)
+    {
+        my_assert(slots[i] != 0 && mem_ptr(slots[i]) != slots);
+        for (int j = 0; j < i; j++)
+            my_assert(slots[i] != slots[j]);
+    }
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 5);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_snapshot()
+{
+    printf_yellow("  Testing snapshot and restore ---> ");
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_memory_manager_%d.snap", getpid());
+    mem_options opts = {.policy = MEM_BEST_FIT};
+    mem_init_opts(64 << 10, &opts);
+    void *blocks[3];
+    for (int i = 0; i < 3; i++)
+    {
+        blocks[i] = mem_alloc(1000);
+        memset(blocks[i], 'a' + i, 1000);
+    }
+    mem_free(blocks[1]);
+    // a pointer stored inside the pool
+    void **link = mem_alloc(sizeof(void *));
+    *link = blocks[2];
+    mem_set_root(link);
+    my_assert(mem_snapshot(path));
+    mem_stats before;
+    mem_get_stats(&before);
+
+    // Nothing done after the snapshot survives the restore
+    mem_alloc(5000);
+    memset(blocks[0], 'z', 1000);
+    my_assert(mem_restore(path));
+    mem_stats after;
+    mem_get_stats(&after);
+    my_assert(after.used_blocks == before.used_blocks);
+    my_assert(after.free_bytes == before.free_bytes);
+    link = mem_get_root();
+    my_assert(link != NULL);
+    char *third = mem_relocate(*link);
+    my_assert(mem_owns(third) && third[0] == 'c' && third[999] == 'c');
+
+    // The restored pool carries on as usual, the freed hole is reused
+    void *block = mem_alloc(1000);
+    my_assert(block != NULL && mem_owns(block));
+    mem_free(block);
+    mem_free(third);
+    mem_free(link);
+
+    // A bad file leaves the pool alone
+    my_assert(!mem_restore("/nonexistent/snapshot"));
+    my_assert(mem_owns(third));
+    mem_deinit();
+    unlink(path);
+    printf_green("[PASS].\n");
+}
+
+void test_deferred_free()
+{
+    printf_yellow("  Testing deferred frees ---> ");
+    mem_init(64 << 10);
+    void *blocks[200];
+    for (int round = 0; round < 5; round++)
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            blocks[i] = mem_alloc(4 + i);
+            my_assert(blocks[i] != NULL);
+        }
+        // the reclaimer frees these while this thread keeps allocating
+        for (int i = 0; i < 200; i += 2)
+            mem_free_deferred(blocks[i]);
+        for (int i = 1; i < 200; i += 2)
+        {
+            mem_free(blocks[i]);
+            blocks[i] = mem_alloc(8);
+            my_assert(blocks[i] != NULL);
+            mem_free(blocks[i]);
+        }
+        mem_flush_deferred();
+        mem_stats stats;
+        mem_get_stats(&stats);
+        my_assert(stats.used_blocks == 0);
+        placement_assert(stats.free_runs == 1);
+    }
+
+    // Whatever is still queued is dealt with by mem_deinit
+    for (int i = 0; i < 200; i++)
+        mem_free_deferred(mem_alloc(16));
+    mem_deinit();
+
+    // Offsets can't link blocks of pools that grow past 16 GiB, they are
+    // freed right away
+    mem_options opts = {.max_size = (size_t)20 << 30};
+    mem_init_opts(4096, &opts);
+    void *kept = mem_alloc(16);
+    if (kept != NULL) // the reservation may be refused
+    {
+        mem_free_deferred(mem_alloc(16));
+        mem_stats stats;
+        mem_get_stats(&stats);
+        my_assert(stats.used_blocks == 1);
+    }
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_tagged_alloc()
+{
+    printf_yellow("  Testing tagged allocations ---> ");
+    mem_init(8192);
+    mem_tag_stats stats[MEM_TAG_COUNT];
+
+    void *a = mem_alloc_tagged(1, 100);
+    void *b = mem_alloc_tagged(1, 50);
+    void *c = mem_alloc_tagged(2, 10);
+    void *plain = mem_alloc(10);
+    my_assert(a && b && c && plain);
+    my_assert(mem_tag_of(a) == 1 && mem_tag_of(c) == 2 && mem_tag_of(plain) == -1);
+    my_assert(mem_usable_size(a) >= 100);
+    memset(a, 0xFF, mem_usable_size(a));
+    my_assert(mem_tag_of(a) == 1);
+    mem_tag_snapshot(stats);
+    size_t tag1 = stats[1].live;
+    my_assert(tag1 >= 150 && stats[1].allocations == 2);
+    my_assert(stats[2].live >= 10 && stats[0].live == 0);
+
+    // Freeing gives the bytes back, the peak stays
+    mem_free(b);
+    mem_tag_snapshot(stats);
+    my_assert(stats[1].live < tag1 && stats[1].live >= 100);
+    my_assert(stats[1].peak == tag1);
+
+    // Resizing keeps the tag and the contents
+    a = mem_resize(a, 1000);
+    my_assert(a != NULL && mem_tag_of(a) == 1);
+    my_assert(((unsigned char *)a)[99] == 0xFF);
+    mem_tag_snapshot(stats);
+    my_assert(stats[1].live >= 1000);
+
+    // A limit fails the allocation, not the pool
+    mem_tag_set_limit(2, 400);
+    my_assert(mem_alloc_tagged(2, 500) == NULL);
+    my_assert(mem_resize(c, 500) == NULL && mem_tag_of(c) == 2);
+    void *d = mem_alloc_tagged(2, 100);
+    my_assert(d != NULL);
+    void *e = mem_alloc_tagged(3, 500);
+    my_assert(e != NULL);
+    mem_tag_snapshot(stats);
+    my_assert(stats[2].failures == 2 && stats[2].live <= 400);
+
+    my_assert(mem_alloc_tagged(MEM_TAG_COUNT, 10) == NULL);
+    mem_free(a);
+    mem_free(c);
+    mem_free(d);
+    mem_free(e);
+    mem_free(plain);
+    mem_tag_snapshot(stats);
+    for (int i = 0; i < MEM_TAG_COUNT; i++)
+        my_assert(stats[i].live == 0);
+    mem_stats pool;
+    mem_get_stats(&pool);
+    my_assert(pool.used_blocks == 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+void test_batch_alloc()
+{
+    printf_yellow("  Testing batch allocation ---> ");
+    mem_policy policies[] = {MEM_FIRST_FIT, MEM_NEXT_FIT, MEM_BEST_FIT, MEM_GOOD_FIT};
+    for (int p = 0; p < 4; p++)
+    {
+        mem_options opts = {.policy = policies[p]};
+        mem_init_opts(4096, &opts);
+        void *blocks[64];
+
+        // One free block, so the batch is laid out back to back
+        my_assert(mem_alloc_batch(16, 64, blocks));
+        for (int i = 1; i < 64; i++)
+            placement_assert((char *)blocks[i] - (char *)blocks[i - 1] == 20);
+        for (int i = 0; i < 64; i++)
+            memset(blocks[i], i, 16);
+        for (int i = 0; i < 64; i++)
+            my_assert(((unsigned char *)blocks[i])[15] == i);
+
+        // Freeing them all leaves a single free run
+        mem_free_batch(blocks, 64);
+        mem_stats stats;
+        mem_get_stats(&stats);
+        my_assert(stats.used_blocks == 0);
+        placement_assert(stats.free_runs == 1);
+        size_t largest = stats.largest_free;
+
+        // A batch that doesn't fit allocates nothing
+        my_assert(!mem_alloc_batch(100, 64, blocks));
+        mem_get_stats(&stats);
+        my_assert(stats.used_blocks == 0);
+        placement_assert(stats.largest_free == largest);
+
+        // Spread over the holes left by every other block
+        my_assert(mem_alloc_batch(100, 20, blocks));
+        for (int i = 0; i < 20; i++)
+            memset(blocks[i], 0x11, 100);
+        for (int i = 0; i < 20; i += 2)
+            mem_free(blocks[i]);
+        void *more[25];
+        my_assert(mem_alloc_batch(100, 25, more));
+        for (int i = 0; i < 25; i++)
+            memset(more[i], 0xAB, 100);
+        for (int i = 1; i < 20; i += 2)
+            my_assert(((unsigned char *)blocks[i])[0] == 0x11 &&
+                      ((unsigned char *)blocks[i])[99] == 0x11);
+        mem_free_batch(more, 25);
+        for (int i = 1; i < 20; i += 2)
+            mem_free(blocks[i]);
+        mem_get_stats(&stats);
+        my_assert(stats.used_blocks == 0);
+        mem_deinit();
+    }
+    printf_green("[PASS].\n");
+}
+
+void test_adaptive_classes()
+{
+    printf_yellow("  Testing adaptive size classes ---> ");
+    mem_options opts = {.adaptive = true};
+    mem_init_opts(65536, &opts);
+    size_t classes[8];
+    my_assert(mem_adapt_classes(classes, 8) == 0);
+
+    // Mostly node sized requests, some bigger ones
+    void *blocks[100];
+    for (int round = 0; round < 50; round++)
+    {
+        for (int i = 0; i < 100; i++)
+            blocks[i] = mem_alloc(i % 4 ? 16 : 100);
+        for (int i = 0; i < 100; i++)
+            mem_free(blocks[i]);
+    }
+    int count = mem_adapt_classes(classes, 8);
+    my_assert(count == 2 && classes[0] == 16 && classes[1] == 100);
+
+    // A freed block of a class size goes to the next request of that size,
+    // without losing what mem_calloc promises
+    void *a = mem_alloc(16);
+    memset(a, 0xFF, 16);
+    mem_free(a);
+    char *b = mem_calloc(1, 16);
+    placement_assert((void *)b == a);
+    my_assert(all_zero((unsigned char *)b, 16));
+    mem_free(b);
+
+    // Freeing a kept block again is ignored like any other double free
+    mem_free(b);
+    void *c = mem_alloc(16);
+    void *d = mem_alloc(16);
+    placement_assert(c == b);
+    my_assert(d != c);
+    mem_free(c);
+    mem_free(d);
+
+    // Kept blocks show up as cached, reading the stats leaves them there,
+    // and they are given back when space runs out
+    for (int i = 0; i < 100; i++)
+        blocks[i] = mem_alloc(16);
+    for (int i = 0; i < 100; i++)
+        mem_free(blocks[i]);
+    mem_stats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 0 && stats.cached_bytes >= 100 * 16);
+    void *again = mem_alloc(16);
+    placement_assert(again == blocks[99]);
+    mem_free(again);
+    void *big = mem_alloc(65000);
+    my_assert(big != NULL);
+    mem_free(big);
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 0);
+    placement_assert(stats.free_runs == 1 && stats.cached_bytes == 0);
+
+    // So are aligned and batch requests
+    for (int i = 0; i < 100; i++)
+        blocks[i] = mem_alloc(100);
+    for (int i = 0; i < 100; i++)
+        mem_free(blocks[i]);
+    big = mem_alloc_aligned(64, 60000);
+    my_assert(big != NULL);
+    mem_free(big);
+    for (int i = 0; i < 100; i++)
+        blocks[i] = mem_alloc(100);
+    for (int i = 0; i < 100; i++)
+        mem_free(blocks[i]);
+    my_assert(mem_alloc_batch(580, 100, blocks));
+    mem_free_batch(blocks, 100);
+
+    // Another pool starts with the same classes
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_adapt_%d", getpid());
+    my_assert(mem_adapt_save(path));
+    mem_deinit();
+    mem_init(4096);
+    my_assert(mem_adapt_load(path));
+    size_t loaded[8];
+    my_assert(mem_adapt_classes(loaded, 8) == count);
+    my_assert(memcmp(loaded, classes, count * sizeof(size_t)) == 0);
+    a = mem_alloc(16);
+    mem_free(a);
+    b = mem_alloc(16);
+    placement_assert((void *)b == a);
+    mem_deinit();
+
+    FILE *file = fopen(path, "w");
+    fprintf(file, "16 oops\n");
+    fclose(file);
+    mem_init(4096);
+    my_assert(!mem_adapt_load(path));
+    mem_deinit();
+    unlink(path);
+    printf_green("[PASS].\n");
+}
+
+void test_refcounted()
+{
+    printf_yellow("  Testing reference counted blocks ---> ");
+    mem_init(1024);
+    char *block = mem_alloc_rc(10);
+    my_assert(block != NULL && mem_refcount(block) == 1);
+    memset(block, 'a', 10);
+    mem_retain(block);
+    mem_retain(block);
+    my_assert(mem_refcount(block) == 3 && block[9] == 'a');
+    my_assert(!mem_release(block));
+    my_assert(!mem_release(block));
+    my_assert(mem_refcount(block) == 1 && block[9] == 'a');
+    my_assert(mem_release(block));
+    mem_stats stats;
+    mem_get_stats(&stats);
+    my_assert(stats.used_blocks == 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+typedef struct test_cache
+{
+    void *blocks[8];
+    int count;
+    int calls;
+} test_cache;
+
+static size_t shrink_cache(size_t wanted, void *ctx)
+{
+    test_cache *cache = ctx;
+    cache->calls++;
+    // allocating from a callback doesn't reclaim again
+    my_assert(mem_alloc(100000) == NULL);
+    size_t freed = 0;
+    while (cache->count && freed < wanted)
+    {
+        mem_free(cache->blocks[--cache->count]);
+        freed += 100;
+    }
+    return freed;
+}
+
+void test_reclaim_callbacks()
+{
+    printf_yellow("  Testing reclaim callbacks ---> ");
+    mem_init(1024);
+    test_cache first = {0}, second = {0};
+    for (int i = 0; i < 4; i++)
+        first.blocks[first.count++] = mem_alloc(100);
+    for (int i = 0; i < 4; i++)
+        second.blocks[second.count++] = mem_alloc(100);
+    my_assert(mem_reclaim_register(shrink_cache, &second, 2));
+    my_assert(mem_reclaim_register(shrink_cache, &first, 1));
+
+    // The lower priority sheds first, and is enough
+    void *block = mem_alloc(300);
+    my_assert(block != NULL);
+    my_assert(first.calls == 1 && second.calls == 0 && first.count == 1);
+    mem_free(block);
+
+    // Once it has nothing left the next one is asked
+    mem_reclaim_unregister(shrink_cache, &first);
+    block = mem_alloc(700);
+    my_assert(block != NULL && first.calls == 1 && second.calls >= 1);
+    mem_free(block);
+
+    // Nothing left anywhere, the allocation fails after asking everyone
+    my_assert(mem_reclaim_register(shrink_cache, &first, 1));
+    int calls = first.calls + second.calls;
+    my_assert(mem_alloc(2000) == NULL);
+    my_assert(first.calls + second.calls == calls + 2);
+
+    // Crossing the watermark reclaims without anything failing
+    my_assert(first.count == 0 && second.count == 0);
+    first.calls = second.calls = 0;
+    first.blocks[first.count++] = mem_alloc(100);
+    mem_set_watermark(950);
+    block = mem_alloc(10);
+    my_assert(block != NULL && first.calls == 1 && first.count == 0);
+    mem_free(block);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+
+#ifdef MEM_DEBUG
+void test_debug_heap()
+{
+    printf_yellow("  Testing the debug heap ---> ");
+    mem_init(4096);
+    size_t errors = mem_debug_errors();
+
+    // Correct use reports nothing
+    char *block = mem_alloc(10);
+    my_assert(block != NULL);
+    my_assert(mem_usable_size(block) == 10);
+    memset(block, 'a', 10);
+    mem_free(block);
+    char *aligned = mem_alloc_aligned(64, 100);
+    my_assert(aligned != NULL && ((uintptr_t)aligned & 63) == 0);
+    char *zeroed = mem_calloc(10, 10);
+    my_assert(zeroed != NULL && all_zero(zeroed, 100));
+    mem_free(aligned);
+    mem_free(zeroed);
+    my_assert(mem_debug_errors() == errors);
+
+    // One past the end
+    block = mem_alloc(10);
+    block[10] = 'x';
+    mem_free(block);
+    my_assert(mem_debug_errors() == ++errors);
+
+    // One before the start
+    block = mem_alloc(10);
+    block[-1] = 'x';
+    mem_free(block);
+    my_assert(mem_debug_errors() == ++errors);
+
+    // Double free
+    block = mem_alloc(10);
+    mem_free(block);
+    mem_free(block);
+    my_assert(mem_debug_errors() == ++errors);
+
+    // Pointer into the middle of a block
+    block = mem_alloc(64);
+    mem_free(block + 8);
+    my_assert(mem_debug_errors() == ++errors);
+    mem_free(block);
+
+    // Resizing keeps the contents
+    block = mem_alloc(10);
+    memset(block, 'b', 10);
+    block = mem_resize(block, 100);
+    my_assert(block != NULL && block[9] == 'b');
+    mem_free(block);
+    my_assert(mem_debug_errors() == errors);
+
+    // Deferred frees of blocks too small to hold the link
+    block = mem_alloc(1);
+    mem_free_deferred(block);
+    mem_flush_deferred();
+    my_assert(mem_debug_errors() == errors);
+
+    // Write after free, caught once the quarantine is drained
+    block = mem_alloc(10);
+    mem_free(block);
+    block[0] = 'x';
+    mem_deinit();
+    my_assert(mem_debug_errors() == ++errors);
+    printf_green("[PASS].\n");
+}
+#endif
+
+#ifdef MEM_PERF
+static void *perf_worker(void *arg)
+{
+    for (int i = 0; i < 50; i++)
+        mem_free(mem_alloc(32));
+    return arg;
+}
+
+void test_perf_counters()
+{
+    printf_yellow("  Testing perf counter regions ---> ");
+    mem_init(4096);
+    perf_reset();
+    for (int i = 0; i < 100; i++)
+        mem_free(mem_alloc(32));
+
+    // Calls are counted whether or not perf events are permitted
+    perf_stats stats;
+    my_assert(perf_region_stats("mem_alloc", &stats));
+    my_assert(stats.calls == 100);
+    if (perf_counter_available(PERF_INSTRUCTIONS))
+        my_assert(stats.counts[PERF_INSTRUCTIONS] > 0);
+    my_assert(!perf_region_stats("no_such_region", &stats));
+
+    // Threads count on their own and are summed
+    pthread_t thread;
+    pthread_create(&thread, NULL, perf_worker, NULL);
+    pthread_join(thread, NULL);
+    my_assert(perf_region_stats("mem_free", &stats));
+    my_assert(stats.calls == 150);
+
+    char *report = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&report, &length);
+    perf_report(out);
+    fclose(out);
+    my_assert(strstr(report, "mem_alloc") && strstr(report, "2 threads"));
+    free(report);
+
+    perf_reset();
+    perf_region_stats("mem_alloc", &stats);
+    my_assert(stats.calls == 0);
+    mem_deinit();
+    printf_green("[PASS].\n");
+}
+#endif
+
 int main(int argc, char *argv[])
 {
 #ifdef VERSION
@@ -362,7 +1278,24 @@ int main(int argc, char *argv[])
 
 	printf("\nVarious tests: \n");
 	printf(" 17. test_zero_alloc_and_free - Ensure that we can allocate 0 bytes, and it does not fail.\n");
-	printf(" 18. test_random_blocks - Test that we can allocate a random size, and random amounts of blocks [1000,10000]. \n\n");
+	printf(" 18. test_random_blocks - Test that we can allocate a random size, and random amounts of blocks [1000,10000]. \n");
+	printf(" 19. test_grow - Test growing the pool in place.\n");
+	printf(" 20. test_aligned_alloc - Test aligned allocations.\n");
+	printf(" 21. test_placement_policies - Test first, next, best and good fit.\n");
+	printf(" 22. test_calloc - Test zeroed allocations.\n");
+	printf(" 23. test_resize_zeroed - Test resizing with a zeroed tail.\n");
+	printf(" 24. test_numa - Test NUMA partitioned pools.\n");
+	printf(" 25. test_huge_pages - Test huge page backed, prefaulted pools.\n");
+	printf(" 26. test_debug_heap - Test redzones and quarantine, MEM_DEBUG builds only.\n");
+	printf(" 27. test_shared_heap - Test heaps shared between processes.\n");
+	printf(" 28. test_snapshot - Test saving the pool to a file and restoring it.\n");
+	printf(" 29. test_deferred_free - Test freeing on a background thread.\n");
+	printf(" 30. test_tagged_alloc - Test per tag accounting and limits.\n");
+	printf(" 31. test_batch_alloc - Test allocating and freeing many blocks at once.\n");
+	printf(" 32. test_perf_counters - Test perf counter regions, MEM_PERF builds only.\n");
+	printf(" 33. test_adaptive_classes - Test size classes learned from the requests.\n");
+	printf(" 34. test_refcounted - Test reference counted blocks.\n");
+	printf(" 35. test_reclaim_callbacks - Test shedding memory under pressure.\n\n");
         printf(" 0. Run all tests\n");
         return 1;
     }
@@ -399,6 +1332,24 @@ int main(int argc, char *argv[])
         printf("\nVarious other tests:\n");
         test_zero_alloc_and_free();
         test_random_blocks();
+        test_grow();
+        test_aligned_alloc();
+        test_placement_policies();
+        test_calloc();
+        test_resize_zeroed();
+        test_numa();
+        test_huge_pages();
+        test_shared_heap();
+        test_snapshot();
+        test_deferred_free();
+        test_tagged_alloc();
+        test_batch_alloc();
+        test_adaptive_classes();
+        test_refcounted();
+        test_reclaim_callbacks();
+#ifdef MEM_DEBUG
+        test_debug_heap();
+#endif
         break;
     case 1:
         test_init();
@@ -454,6 +1405,61 @@ int main(int argc, char *argv[])
     case 18:
         test_random_blocks();
         break;
+    case 19:
+        test_grow();
+        break;
+    case 20:
+        test_aligned_alloc();
+        break;
+    case 21:
+        test_placement_policies();
+        break;
+    case 22:
+        test_calloc();
+        break;
+    case 23:
+        test_resize_zeroed();
+        break;
+    case 24:
+        test_numa();
+        break;
+    case 25:
+        test_huge_pages();
+        break;
+#ifdef MEM_DEBUG
+    case 26:
+        test_debug_heap();
+        break;
+#endif
+    case 27:
+        test_shared_heap();
+        break;
+    case 28:
+        test_snapshot();
+        break;
+    case 29:
+        test_deferred_free();
+        break;
+    case 30:
+        test_tagged_alloc();
+        break;
+    case 31:
+        test_batch_alloc();
+        break;
+#ifdef MEM_PERF
+    case 32:
+        test_perf_counters();
+        break;
+#endif
+    case 33:
+        test_adaptive_classes();
+        break;
+    case 34:
+        test_refcounted();
+        break;
+    case 35:
+        test_reclaim_callbacks();
+        break;
     default:
         printf("Invalid test function\n");
         break;
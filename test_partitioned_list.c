@@ -0,0 +1,150 @@
+#include "partitioned_list.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "common_defs.h"
+
+// Values are i % 1000 so every value shows up count / 1000 times
+static void fill(PList *list, int count)
+{
+    for (int i = 0; i < count; i++)
+        plist_insert(list, i % 1000);
+}
+
+void test_plist_insert(int count)
+{
+    printf_yellow(" Testing plist_insert ---> ");
+    PList list;
+    plist_init(&list, sizeof(Node) * count, 100, 4);
+    fill(&list, count);
+    my_assert(plist_count_nodes(&list) == (size_t)count);
+    my_assert(list.segment_count == (count + 99) / 100);
+    // segments joined up are the list in insertion order
+    int expected = 0;
+    for (int s = 0; s < list.segment_count; s++)
+        for (Node *walker = list.segments[s].head; walker; walker = walker->next)
+            my_assert(walker->data == expected++ % 1000);
+    my_assert(expected == count);
+    plist_cleanup(&list);
+    printf_green("[PASS].\n");
+}
+
+void test_plist_search(int count)
+{
+    printf_yellow(" Testing plist_search ---> ");
+    PList list;
+    plist_init(&list, sizeof(Node) * count, 64, 8);
+    fill(&list, count);
+    // the first match in list order, however the threads race
+    for (int round = 0; round < 20; round++)
+    {
+        Node *found = plist_search(&list, 999);
+        my_assert(found != NULL && found->data == 999);
+        int position = 0;
+        for (int s = 0; s < list.segment_count; s++)
+            for (Node *walker = list.segments[s].head; walker; walker = walker->next, position++)
+                if (walker == found)
+                    my_assert(position == 999);
+    }
+    my_assert(plist_search(&list, 1000) == NULL);
+    plist_cleanup(&list);
+    printf_green("[PASS].\n");
+}
+
+void test_plist_count(int count)
+{
+    printf_yellow(" Testing plist_count_value ---> ");
+    PList list;
+    plist_init(&list, sizeof(Node) * count, 0, 0);
+    fill(&list, count);
+    my_assert(plist_count_value(&list, 7) == (size_t)count / 1000);
+    my_assert(plist_count_value(&list, 1000) == 0);
+    plist_cleanup(&list);
+
+    // a single thread gets the same answers
+    plist_init(&list, sizeof(Node) * count, 128, 1);
+    fill(&list, count);
+    my_assert(plist_count_value(&list, 7) == (size_t)count / 1000);
+    plist_cleanup(&list);
+    printf_green("[PASS].\n");
+}
+
+static uint16_t add(uint16_t data, void *ctx)
+{
+    return data + *(int *)ctx;
+}
+
+static bool is_even(uint16_t data, void *ctx)
+{
+    return data % 2 == 0;
+}
+
+void test_plist_map_filter(int count)
+{
+    printf_yellow(" Testing plist_map and plist_filter ---> ");
+    PList list;
+    plist_init(&list, sizeof(Node) * count, 100, 4);
+    fill(&list, count);
+    int one = 1;
+    plist_map(&list, add, &one);
+    my_assert(plist_count_value(&list, 1000) == (size_t)count / 1000);
+    my_assert(plist_count_value(&list, 0) == 0);
+
+    my_assert(plist_filter(&list, is_even, NULL) == (size_t)count / 2);
+    my_assert(plist_count_nodes(&list) == (size_t)count / 2);
+    my_assert(plist_count_value(&list, 1) == 0);
+    my_assert(plist_count_value(&list, 2) == (size_t)count / 1000);
+    // order kept and the freed nodes can be reused
+    int expected = 2;
+    for (int s = 0; s < list.segment_count; s++)
+        for (Node *walker = list.segments[s].head; walker; walker = walker->next, expected += 2)
+            my_assert(walker->data == (expected - 1) % 1000 + 1);
+    fill(&list, 50);
+    my_assert(plist_count_nodes(&list) == (size_t)count / 2 + 50);
+    plist_cleanup(&list);
+    printf_green("[PASS].\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <test function>\n", argv[0]);
+        printf("Available test functions:\n");
+        printf(" 1. test_plist_insert - Test inserting across segments\n");
+        printf(" 2. test_plist_search - Test parallel search\n");
+        printf(" 3. test_plist_count - Test parallel counting\n");
+        printf(" 4. test_plist_map_filter - Test parallel map and filter\n");
+        printf(" 0. Run all tests\n");
+        return 1;
+    }
+
+    switch (atoi(argv[1]))
+    {
+    case 0:
+        printf("Testing Partitioned List:\n");
+        test_plist_insert(10000);
+        test_plist_search(10000);
+        test_plist_count(10000);
+        test_plist_map_filter(10000);
+        break;
+    case 1:
+        test_plist_insert(10000);
+        break;
+    case 2:
+        test_plist_search(10000);
+        break;
+    case 3:
+        test_plist_count(10000);
+        break;
+    case 4:
+        test_plist_map_filter(10000);
+        break;
+
+    default:
+        printf("Invalid test function\n");
+        break;
+    }
+
+    return 0;
+}
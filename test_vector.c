@@ -0,0 +1,130 @@
+#include "vector.h"
+#include <stdio.h>
+#include <string.h>
+
+#include "common_defs.h"
+
+void test_vec_push_pop(int count)
+{
+    printf_yellow(" Testing vec_push and vec_pop ---> ");
+    Vector vec;
+    vec_init(&vec, sizeof(uint16_t) * count * 2);
+    for (int i = 0; i < count; i++)
+        vec_push(&vec, i);
+    my_assert(vec_count(&vec) == (size_t)count);
+    my_assert(vec.capacity >= (size_t)count && vec.capacity < (size_t)count * 2);
+    uint16_t value;
+    for (int i = count - 1; i >= 0; i--)
+    {
+        my_assert(vec_pop(&vec, &value));
+        my_assert(value == i);
+    }
+    my_assert(!vec_pop(&vec, &value));
+    vec_cleanup(&vec);
+    printf_green("[PASS].\n");
+}
+
+void test_vec_insert_erase()
+{
+    printf_yellow(" Testing vec_insert, vec_erase and vec_delete ---> ");
+    Vector vec;
+    vec_init(&vec, 64);
+    vec_push(&vec, 10);
+    vec_push(&vec, 30);
+    vec_insert(&vec, 1, 20);
+    vec_insert(&vec, 0, 0);
+    vec_insert(&vec, 4, 40);
+    vec_insert(&vec, 9, 99); // past the end
+    my_assert(vec_count(&vec) == 5);
+    for (int i = 0; i < 5; i++)
+        my_assert(vec.data[i] == i * 10);
+    vec_erase(&vec, 0);
+    vec_erase(&vec, 5);
+    my_assert(vec.data[0] == 10 && vec_count(&vec) == 4);
+    vec_delete(&vec, 30);
+    vec_delete(&vec, 99);
+    my_assert(vec_count(&vec) == 3 && vec.data[2] == 40);
+    vec_cleanup(&vec);
+    printf_green("[PASS].\n");
+}
+
+void test_vec_find(int count)
+{
+    printf_yellow(" Testing vec_find ---> ");
+    Vector vec;
+    vec_init(&vec, sizeof(uint16_t) * count * 2);
+    for (int i = 0; i < count; i++)
+        vec_push(&vec, i % 1000);
+    // in the first chunk, a later chunk and the tail after the last chunk
+    my_assert(vec_find(&vec, 5) == 5);
+    my_assert(vec_find(&vec, 700) == 700);
+    vec_push(&vec, 4000);
+    my_assert(vec_find(&vec, 4000) == count);
+    my_assert(vec_find(&vec, 5000) == -1);
+    vec_cleanup(&vec);
+    printf_green("[PASS].\n");
+}
+
+void test_vec_reserve()
+{
+    printf_yellow(" Testing vec_reserve ---> ");
+    Vector vec;
+    vec_init(&vec, 1024);
+    my_assert(vec_reserve(&vec, 100));
+    uint16_t *data = vec.data;
+    for (int i = 0; i < 100; i++)
+        vec_push(&vec, i);
+    my_assert(vec.data == data);
+    my_assert(!vec_reserve(&vec, 100000));
+    my_assert(vec_count(&vec) == 100 && vec.data[99] == 99);
+    // filling the pool up to the last element, past what doubling allows
+    while (vec_count(&vec) < 512)
+        vec_push(&vec, 1);
+    my_assert(vec_count(&vec) == 512);
+    vec_cleanup(&vec);
+    printf_green("[PASS].\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        printf("Usage: %s <test function>\n", argv[0]);
+        printf("Available test functions:\n");
+        printf(" 1. test_vec_push_pop - Test adding and removing at the end\n");
+        printf(" 2. test_vec_insert_erase - Test adding and removing in the middle\n");
+        printf(" 3. test_vec_find - Test search\n");
+        printf(" 4. test_vec_reserve - Test reserving room up front\n");
+        printf(" 0. Run all tests\n");
+        return 1;
+    }
+
+    switch (atoi(argv[1]))
+    {
+    case 0:
+        printf("Testing Vector:\n");
+        test_vec_push_pop(1000);
+        test_vec_insert_erase();
+        test_vec_find(1000);
+        test_vec_reserve();
+        break;
+    case 1:
+        test_vec_push_pop(1000);
+        break;
+    case 2:
+        test_vec_insert_erase();
+        break;
+    case 3:
+        test_vec_find(1000);
+        break;
+    case 4:
+        test_vec_reserve();
+        break;
+
+    default:
+        printf("Invalid test function\n");
+        break;
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "vector.h"
+
+// vec_find compares this many elements between checks for a match
+#define VEC_FIND_CHUNK 64
+#define VEC_MIN_CAPACITY 8
+
+/// @brief Initializes the vector
+/// @param vec
+/// @param size size in bytes
+void vec_init(Vector* vec, size_t size) {
+    mem_init(size + 8);  // room for the block header and alignment
+    vec->data = NULL;
+    vec->length = 0;
+    vec->capacity = 0;
+}
+
+/// @brief makes room for capacity elements without moving them again
+/// @param vec
+/// @param capacity number of elements
+/// @return false if out of memory, the vector is unchanged then
+bool vec_reserve(Vector* vec, size_t capacity) {
+    if (capacity <= vec->capacity) return true;
+    uint16_t* data = mem_resize(vec->data, capacity * sizeof(uint16_t));
+    if (!data) return false;
+    vec->data = data;
+    vec->capacity = mem_usable_size(data) / sizeof(uint16_t);
+    return true;
+}
+
+/// @brief room for one more element, doubling the capacity if needed and
+/// settling for just enough if doubling doesn't fit
+static bool vec_grow(Vector* vec) {
+    if (vec->length < vec->capacity) return true;
+    size_t capacity = vec->capacity ? vec->capacity * 2 : VEC_MIN_CAPACITY;
+    return vec_reserve(vec, capacity) || vec_reserve(vec, vec->length + 1);
+}
+
+/// @brief inserts last in the vector
+/// @param vec
+/// @param data value to add
+void vec_push(Vector* vec, uint16_t data) {
+    if (!vec_grow(vec)) return;
+    vec->data[vec->length++] = data;
+}
+
+/// @brief removes the last element
+/// @param vec
+/// @param data set to the removed value
+/// @return false if the vector is empty
+bool vec_pop(Vector* vec, uint16_t* data) {
+    if (vec->length == 0) return false;
+    *data = vec->data[--vec->length];
+    return true;
+}
+
+/// @brief inserts data so that it ends up at index
+/// @param vec
+/// @param index 0 to vec->length
+/// @param data value to add
+void vec_insert(Vector* vec, size_t index, uint16_t data) {
+    if (index > vec->length || !vec_grow(vec)) return;
+    memmove(vec->data + index + 1, vec->data + index,
+            (vec->length - index) * sizeof(uint16_t));
+    vec->data[index] = data;
+    vec->length++;
+}
+
+/// @brief removes the element at index, keeping the order of the rest
+/// @param vec
+/// @param index
+void vec_erase(Vector* vec, size_t index) {
+    if (index >= vec->length) return;
+    memmove(vec->data + index, vec->data + index + 1,
+            (vec->length - index - 1) * sizeof(uint16_t));
+    vec->length--;
+}
+
+/// @brief removes the first element holding data
+/// @param vec
+/// @param data
+void vec_delete(Vector* vec, uint16_t data) {
+    ptrdiff_t index = vec_find(vec, data);
+    if (index >= 0) vec_erase(vec, index);
+}
+
+/// @brief returns the index of the first element holding data
+/// @param vec
+/// @param data value to search for
+/// @return index or -1 if not found
+ptrdiff_t vec_find(Vector* vec, uint16_t data) {
+    const uint16_t* values = vec->data;
+    size_t i = 0;
+    // no early exit inside a chunk, so the compiler can vectorise the compare
+    for (; i + VEC_FIND_CHUNK <= vec->length; i += VEC_FIND_CHUNK) {
+        int found = 0;
+        for (size_t j = 0; j < VEC_FIND_CHUNK; j++)
+            found |= values[i + j] == data;
+        if (found) break;
+    }
+    for (; i < vec->length; i++)
+        if (values[i] == data) return i;
+    return -1;
+}
+
+/// @brief displays all elements
+/// @param vec
+void vec_display(Vector* vec) {
+    printf("[");
+    for (size_t i = 0; i < vec->length; i++)
+        printf(i ? ", %d" : "%d", vec->data[i]);
+    printf("]");
+}
+
+/// @brief returns the number of elements
+/// @param vec
+size_t vec_count(Vector* vec) { return vec->length; }
+
+/// @brief frees all used memory
+/// @param vec
+void vec_cleanup(Vector* vec) {
+    mem_free(vec->data);
+    vec->data = NULL;
+    vec->length = vec->capacity = 0;
+    mem_deinit();
+}
@@ -0,0 +1,40 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "common_defs.h"
+#include "memory_manager.h"
+
+// Contiguous counterpart of the linked list, one block from the memory
+// manager that doubles in size whenever it runs out of room
+typedef struct Vector {
+    uint16_t* data;
+    size_t length;
+    size_t capacity;
+} Vector;
+
+void vec_init(Vector* vec, size_t size);
+
+bool vec_reserve(Vector* vec, size_t capacity);
+
+void vec_push(Vector* vec, uint16_t data);
+
+bool vec_pop(Vector* vec, uint16_t* data);
+
+void vec_insert(Vector* vec, size_t index, uint16_t data);
+
+void vec_erase(Vector* vec, size_t index);
+
+void vec_delete(Vector* vec, uint16_t data);
+
+ptrdiff_t vec_find(Vector* vec, uint16_t data);
+
+void vec_display(Vector* vec);
+
+size_t vec_count(Vector* vec);
+
+void vec_cleanup(Vector* vec);
+
+#endif